@@ -0,0 +1,105 @@
+#include "basic_client.hpp"
+#include "error.hpp"
+
+using namespace std;
+
+specializedClient::~specializedClient(){
+
+}
+
+specializedClient * specializedClient::create(bool tlsMode, bool blocking){
+	if (tlsMode && blocking){
+		return new basic_client<tlsTransport, blockingIo>();
+	}
+	if (tlsMode){
+		return new basic_client<tlsTransport, nonBlockingIo>();
+	}
+	if (blocking){
+		return new basic_client<plainTransport, blockingIo>();
+	}
+	return new basic_client<plainTransport, nonBlockingIo>();
+}
+
+template <class Transport, class IoMode>
+basic_client<Transport, IoMode>::basic_client() : m_socket(-1){
+
+}
+
+template <class Transport, class IoMode>
+basic_client<Transport, IoMode>::~basic_client(){
+	disconnect();
+}
+
+template <class Transport, class IoMode>
+bool basic_client<Transport, IoMode>::connect(int32_t socket, SSL_CTX * sslContext){
+	try {
+		m_socket = socket;
+		if (!m_transport.attach(m_socket, sslContext, false)){
+			throw clientError("can't create SSL", ERROR_CLIENT_CONNECT);
+		}
+		ssize_t ret;
+		while ((ret = m_transport.handshake()) != 1){
+			if ((ret != TRANSPORT_WANT_READ && ret != TRANSPORT_WANT_WRITE) || !transportWait(m_socket, ret)){
+				throw clientError("SSL_connect error", ERROR_CLIENT_CONNECT);
+			}
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+template <class Transport, class IoMode>
+void basic_client<Transport, IoMode>::disconnect(){
+	m_transport.release();
+	m_socket = -1;
+}
+
+template <class Transport, class IoMode>
+bool basic_client<Transport, IoMode>::write(const char * buffer, size_t size){
+	try {
+		size_t sent = 0;
+		while (sent < size){
+			ssize_t ret = m_transport.write(m_socket, buffer + sent, size - sent);
+			if (ret > 0){
+				sent += ret;
+			}
+			else if ((ret != TRANSPORT_WANT_READ && ret != TRANSPORT_WANT_WRITE) || (!IoMode::blocking && !transportWait(m_socket, ret))){
+				throw clientError("error while writing to server", ERROR_CLIENT_WRITE);
+			}
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return false;
+	}
+	return true;
+}
+
+template <class Transport, class IoMode>
+bool basic_client<Transport, IoMode>::read(char buffer[MAX_BUFFER_SIZE], size_t * size){
+	try {
+		memset(buffer, 0, MAX_BUFFER_SIZE*sizeof(char));
+		*size = 0;
+		ssize_t ret = m_transport.read(m_socket, buffer, MAX_BUFFER_SIZE);
+		if (ret > 0){
+			*size = ret;
+		}
+		else if (ret == TRANSPORT_ERROR){
+			throw clientError("error while reading from server", ERROR_CLIENT_READ);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return false;
+	}
+	return true;
+}
+
+template class basic_client<plainTransport, blockingIo>;
+template class basic_client<plainTransport, nonBlockingIo>;
+template class basic_client<tlsTransport, blockingIo>;
+template class basic_client<tlsTransport, nonBlockingIo>;
@@ -0,0 +1,70 @@
+#ifndef BASIC_CLIENT_HPP
+#define BASIC_CLIENT_HPP
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+
+#include "../server/transport.hpp"
+
+#define MAX_BUFFER_SIZE 8192
+
+/* calls of the client class forwarded to the basic_client matching its tls and blocking modes (see client::setLeanMode)
+ * the client class resolves the server, connects the socket and creates the tls context, they are given to connect
+ */
+class specializedClient
+{
+public:
+	virtual ~specializedClient();
+	static specializedClient * create(bool tlsMode, bool blocking);
+	/* returns the basic_client specialized for tlsMode and blocking
+	 */
+	virtual bool connect(int32_t socket, SSL_CTX * sslContext) = 0;
+	virtual void disconnect() = 0;
+	virtual bool write(const char * buffer, size_t size) = 0;
+	virtual bool read(char buffer[MAX_BUFFER_SIZE], size_t * size) = 0;
+};
+
+/* compile-time specialized io of the client class, Transport is plainTransport or tlsTransport and IoMode is blockingIo or nonBlockingIo (see server/transport.hpp)
+ * there is no outbound queue, compression nor multiplexing
+ */
+template <class Transport, class IoMode>
+class basic_client final : public specializedClient
+{
+public:
+	basic_client();
+	~basic_client();
+	bool connect(int32_t socket, SSL_CTX * sslContext) override;
+	/* makes the handshake on the connected socket (owned by the client class), sslContext is ignored by plainTransport
+	 * returns true on success, false otherwise
+	 */
+	void disconnect() override;
+	/* releases the transport, the socket is closed by the client class
+	 */
+	bool write(const char * buffer, size_t size) override;
+	/* writes the size bytes of buffer, waiting for the socket in non-blocking mode too (no outbound queue)
+	 * returns true on success, false otherwise
+	 */
+	bool read(char buffer[MAX_BUFFER_SIZE], size_t * size) override;
+	/* same as client::read, size is 0 if nothing has been received
+	 */
+private:
+	int32_t m_socket;
+	Transport m_transport;
+};
+
+/* instantiated once in the library (basic_client.cpp) */
+extern template class basic_client<plainTransport, blockingIo>;
+extern template class basic_client<plainTransport, nonBlockingIo>;
+extern template class basic_client<tlsTransport, blockingIo>;
+extern template class basic_client<tlsTransport, nonBlockingIo>;
+
+typedef basic_client<plainTransport, blockingIo> plainBlockingClient;
+typedef basic_client<plainTransport, nonBlockingIo> plainClient;
+typedef basic_client<tlsTransport, blockingIo> tlsBlockingClient;
+typedef basic_client<tlsTransport, nonBlockingIo> tlsClient;
+
+#endif /* BASIC_CLIENT_HPP */
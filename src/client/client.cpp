@@ -2,33 +2,97 @@
 
 using namespace std;
 
-client::client(bool tlsMode, bool blocking, string serverIP_URL, string serverPort, string pathToCAFile, bool checkServer) : m_socket(-1), m_tlsMode(tlsMode), m_blocking(blocking), m_resolveHostname(false), m_connected(false), m_checkServer(checkServer), m_pathToCAFile(pathToCAFile), m_sslContext(NULL){
+client::client(bool tlsMode, bool blocking, string serverIP_URL, string serverPort, string pathToCAFile, bool checkServer) : m_socket(-1), m_tlsMode(tlsMode), m_blocking(blocking), m_resolveHostname(false), m_connected(false), m_checkServer(checkServer), m_pathToCAFile(pathToCAFile), m_sslContext(NULL), m_ssl(NULL), m_compressionPool(NULL), m_compressed(false), m_multiplexing(false), m_mux(NULL), m_lean(NULL){
 	signal(SIGPIPE, SIG_IGN);
 	if (tlsMode){
 		SSL_library_init();
 	}
-	struct addrinfo * res;
-	struct addrinfo hints;
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = 0;
-	hints.ai_flags = 0;
-	hints.ai_addrlen = 0;
-	hints.ai_addr = NULL;
-	hints.ai_canonname = NULL;
-	hints.ai_next = NULL;
-	if (getaddrinfo(serverIP_URL.c_str(), serverPort.c_str(), &hints, &res) != 0){
-		m_resolveHostname = false;
-	}
-	else {
-		m_resolveHostname = true;
-		m_serverAddress = *(struct sockaddr_in*)(res->ai_addr);
-		freeaddrinfo(res);
+	memset(&m_serverAddress, 0, sizeof(m_serverAddress));
+	m_serverAddressLength = 0;
+	if (serverIP_URL.compare(0, 5, "unix:") == 0){
+		struct sockaddr_un * address = (struct sockaddr_un *)&m_serverAddress;
+		string path = serverIP_URL.substr(5);
+		if (!path.empty() && path.size() + 1 <= sizeof(address->sun_path)){
+			address->sun_family = AF_UNIX;
+			memcpy(address->sun_path, path.c_str(), path.size() + 1);
+			m_serverAddressLength = sizeof(struct sockaddr_un);
+			if (path[0] == '@'){
+				address->sun_path[0] = '\0';
+				m_serverAddressLength = offsetof(struct sockaddr_un, sun_path) + path.size();
+			}
+			m_resolveHostname = true;
+		}
+		return;
 	}
+	/* connect picks the result up, creating many clients doesn't wait for the dns */
+	m_host = serverIP_URL;
+	m_port = serverPort;
+	resolver::shared().request(m_host, m_port);
+	m_resolveHostname = true;
 }
 
 client::~client(){
 	disconnect();
+	if (m_compressionPool != NULL){
+		delete m_compressionPool;
+	}
+	if (m_lean != NULL){
+		delete m_lean;
+	}
+}
+
+bool client::enableCompression(const string& pathToDictionary, int32_t level, uint32_t threshold){
+	try {
+		if (!compressionPool::available()){
+			throw clientError("library built without zstd support", ERROR_CLIENT_COMPRESSION);
+		}
+		if (m_connected){
+			throw clientError("compression must be enabled before connecting", ERROR_CLIENT_COMPRESSION);
+		}
+		compressionPool * pool = new compressionPool(level, threshold);
+		if (!pool->loadDictionary(pathToDictionary)){
+			delete pool;
+			throw clientError("can't load dictionary " + pathToDictionary, ERROR_CLIENT_COMPRESSION);
+		}
+		if (m_compressionPool != NULL){
+			delete m_compressionPool;
+		}
+		m_compressionPool = pool;
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return false;
+	}
+	return true;
+}
+
+void client::enableMultiplexing(){
+	m_multiplexing = true;
+}
+
+void client::setLeanMode(bool lean){
+	if (m_connected){
+		return;
+	}
+	if (m_lean != NULL){
+		delete m_lean;
+		m_lean = NULL;
+	}
+	if (lean){
+		m_lean = specializedClient::create(m_tlsMode, m_blocking);
+	}
+}
+
+bool client::isCompressed() const{
+	return m_compressed;
+}
+
+bool client::resolved(){
+	if (m_host.empty()){
+		return m_resolveHostname;
+	}
+	vector<resolvedAddress> addresses;
+	return resolver::shared().lookup(m_host, m_port, addresses) != RESOLVER_PENDING;
 }
 
 bool client::connect(){
@@ -39,22 +103,25 @@ bool client::connect(){
 		if (m_connected){
 			throw(clientError("trying to connect with an already connected client", ERROR_CLIENT_UNCONNECTED));
 		}
-		if ((m_socket = socket(m_serverAddress.sin_family, SOCK_STREAM, 0)) == -1){
-			throw(clientError("can't create socket", ERROR_CLIENT_CONNECT));
+		if (m_lean != NULL && (m_compressionPool != NULL || m_multiplexing)){
+			throw clientError("compression and multiplexing aren't available in lean mode", ERROR_CLIENT_CONNECT);
 		}
-		if (!m_blocking){
-			int options;
-			if ((options = fcntl(m_socket, F_GETFL)) == -1){
-				throw clientError("fcntl error", ERROR_CLIENT_CONNECT);
-			}
-			if (fcntl(m_socket, F_SETFL, options | O_NONBLOCK) == -1){
-				throw clientError("fcntl error", ERROR_CLIENT_CONNECT);
-			}
+		vector<resolvedAddress> addresses;
+		if (m_host.empty()){
+			resolvedAddress address;
+			address.address = m_serverAddress;
+			address.length = m_serverAddressLength;
+			addresses.push_back(address);
+		}
+		else if (resolver::shared().wait(m_host, m_port, RESOLVE_TIMEOUT, addresses) != RESOLVER_DONE || addresses.empty()){
+			throw clientError("host unreachable", ERROR_CLIENT_RESOLVE_HOSTNAME);
 		}
-		while (::connect(m_socket, (struct sockaddr*)&m_serverAddress, sizeof(m_serverAddress)) != 0){
-			if (errno != EINPROGRESS){
-				throw(clientError("can't connect to server", ERROR_CLIENT_CONNECT));
+		if ((m_socket = raceConnect(addresses)) == -1){
+			/* the server may have moved, the next connect resolves its name again */
+			if (!m_host.empty()){
+				resolver::shared().invalidate(m_host, m_port);
 			}
+			throw(clientError("can't connect to server", ERROR_CLIENT_CONNECT));
 		}
 		if (m_tlsMode){
 			if ((m_sslContext = SSL_CTX_new(TLS_client_method())) == NULL){
@@ -73,6 +140,18 @@ bool client::connect(){
 			else {
 				SSL_CTX_set_verify(m_sslContext, SSL_VERIFY_NONE, NULL);
 			}
+			/* a write which would block is retried from the outbound queue, where the message has been copied */
+			SSL_CTX_set_mode(m_sslContext, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+			SSL_CTX_set_options(m_sslContext, SSL_OP_ENABLE_KTLS);
+#endif
+		}
+		if (m_lean != NULL){
+			if (!m_lean->connect(m_socket, m_sslContext)){
+				throw clientError("can't connect in lean mode", ERROR_CLIENT_CONNECT);
+			}
+		}
+		else if (m_tlsMode){
 			m_ssl = SSL_new(m_sslContext);
 			if (m_ssl == NULL){
 				throw clientError("can't create SSL", ERROR_CLIENT_CONNECT);
@@ -95,10 +174,102 @@ bool client::connect(){
 		return false;
 	}
 	m_connected = true;
+	if (m_compressionPool != NULL && !negotiateCompression()){
+		return false;
+	}
+	if (m_multiplexing){
+		return negotiateMultiplexing();
+	}
 	return true;
 }
 
+int32_t client::raceConnect(const vector<resolvedAddress>& addresses){
+	struct pollfd attempts[RESOLVER_MAX_ADDRESSES];
+	size_t indexes[RESOLVER_MAX_ADDRESSES];
+	size_t running = 0;
+	size_t next = 0;
+	int32_t winner = -1;
+	uint64_t start = monotonicNow();
+	uint64_t nextAttempt = start;
+	while (winner == -1){
+		uint64_t now = monotonicNow();
+		if (next < addresses.size() && next < RESOLVER_MAX_ADDRESSES && (now >= nextAttempt || running == 0)){
+			/* every attempt is non-blocking so the next address can be tried while it runs */
+			const resolvedAddress& address = addresses[next];
+			int32_t s = socket(address.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+			if (s != -1 && ::connect(s, (struct sockaddr*)&address.address, address.length) == 0){
+				winner = s;
+				m_serverAddress = address.address;
+				m_serverAddressLength = address.length;
+			}
+			else if (s != -1 && errno == EINPROGRESS){
+				attempts[running].fd = s;
+				attempts[running].events = POLLOUT;
+				attempts[running].revents = 0;
+				indexes[running++] = next;
+			}
+			else if (s != -1){
+				close(s);
+			}
+			next++;
+			nextAttempt = now + HAPPY_EYEBALLS_DELAY * 1000;
+			continue;
+		}
+		if (running == 0 || now - start >= (uint64_t)CONNECT_TIMEOUT * 1000){
+			break;
+		}
+		uint64_t wakeup = start + (uint64_t)CONNECT_TIMEOUT * 1000;
+		if (next < addresses.size() && next < RESOLVER_MAX_ADDRESSES && nextAttempt < wakeup){
+			wakeup = nextAttempt;
+		}
+		if (poll(attempts, running, (wakeup - now + 999) / 1000) <= 0){
+			continue;
+		}
+		for (size_t i = 0; i < running && winner == -1;){
+			if (attempts[i].revents == 0){
+				i++;
+				continue;
+			}
+			int error = 0;
+			socklen_t length = sizeof(error);
+			if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0){
+				winner = attempts[i].fd;
+				m_serverAddress = addresses[indexes[i]].address;
+				m_serverAddressLength = addresses[indexes[i]].length;
+			}
+			else {
+				close(attempts[i].fd);
+			}
+			running--;
+			attempts[i] = attempts[running];
+			indexes[i] = indexes[running];
+		}
+	}
+	for (size_t i = 0; i < running; i++){
+		close(attempts[i].fd);
+	}
+	if (winner != -1 && m_blocking){
+		int options = fcntl(winner, F_GETFL);
+		if (options == -1 || fcntl(winner, F_SETFL, options & ~O_NONBLOCK) == -1){
+			close(winner);
+			winner = -1;
+		}
+	}
+	return winner;
+}
+
 void client::disconnect(){
+	m_outbound.clear();
+	m_input.clear();
+	m_early.clear();
+	m_compressed = false;
+	if (m_lean != NULL){
+		m_lean->disconnect();
+	}
+	if (m_mux != NULL){
+		delete m_mux;
+		m_mux = NULL;
+	}
 	if (m_socket != -1){
 		shutdown(m_socket, SHUT_RDWR);
 		close(m_socket);
@@ -112,17 +283,47 @@ void client::disconnect(){
 }
 
 bool client::write(char const buffer[MAX_BUFFER_SIZE]){
+	return write(buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+}
+
+bool client::write(const char * buffer, size_t size){
 	try {
 		if (!m_connected){
 			throw clientError("trying to write on unconnected client", ERROR_CLIENT_UNCONNECTED);
 		}
+		if (m_lean != NULL){
+			if (!m_lean->write(buffer, size < MAX_BUFFER_SIZE ? size : MAX_BUFFER_SIZE)){
+				throw clientError("error while writing to client (lean)", ERROR_CLIENT_WRITE);
+			}
+			return true;
+		}
 		int max_buffer_size;
-		if (strlen(buffer) < MAX_BUFFER_SIZE){
-			max_buffer_size = strlen(buffer);
+		if (size < MAX_BUFFER_SIZE){
+			max_buffer_size = size;
 		}
 		else {
 			max_buffer_size = MAX_BUFFER_SIZE;
 		}
+		char frame[MAX_BUFFER_SIZE + COMPRESSION_HEADER_SIZE];
+		if (m_compressed){
+			ssize_t frameSize = m_compressionPool->encode(buffer, max_buffer_size, frame, sizeof(frame));
+			if (frameSize < 0){
+				throw clientError("can't encode message", ERROR_CLIENT_WRITE);
+			}
+			buffer = frame;
+			max_buffer_size = frameSize;
+		}
+		/* a message written while a file or an older message is being sent waits behind it */
+		if (!m_outbound.empty()){
+			if (!flushMessages()){
+				throw clientError("error while writing to client", ERROR_CLIENT_WRITE);
+			}
+			if (!m_outbound.empty()){
+				m_outbound.pushMessage(buffer, max_buffer_size);
+				return true;
+			}
+		}
+		/* bytes the socket doesn't take are queued, dropping them would desync the framing of the server */
 		if (m_tlsMode){
 			int ret;
 			if ((ret = SSL_write(m_ssl, buffer, max_buffer_size)) <= 0){
@@ -130,11 +331,20 @@ bool client::write(char const buffer[MAX_BUFFER_SIZE]){
 				if (tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_READ){
 					throw clientError("error while writing to client (tls)", ERROR_CLIENT_WRITE);
 				}
+				/* the outbound queue retries the write with the same bytes */
+				m_outbound.pushMessage(buffer, max_buffer_size);
 			}
 		}
 		else {
-			if (send(m_socket, buffer, max_buffer_size, 0) == -1 && errno != EWOULDBLOCK){
-				throw clientError("error while writing to client (non-tls)", ERROR_CLIENT_WRITE);
+			ssize_t sent = send(m_socket, buffer, max_buffer_size, 0);
+			if (sent == -1){
+				if (errno != EWOULDBLOCK && errno != EAGAIN){
+					throw clientError("error while writing to client (non-tls)", ERROR_CLIENT_WRITE);
+				}
+				sent = 0;
+			}
+			if (sent < max_buffer_size){
+				m_outbound.pushMessage(buffer + sent, max_buffer_size - sent);
 			}
 		}
 	}
@@ -146,25 +356,322 @@ bool client::write(char const buffer[MAX_BUFFER_SIZE]){
 	return true;
 }
 
-bool client::read(char buffer[MAX_BUFFER_SIZE]){
+bool client::sendFile(int32_t fd, off_t offset, size_t len){
+	try {
+		if (!m_connected){
+			throw clientError("trying to send a file on unconnected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if (m_compressed){
+			/* the server decodes every byte as compressed frames */
+			throw clientError("files can't be sent on a compressed client", ERROR_CLIENT_WRITE);
+		}
+		if (m_mux != NULL){
+			/* the server reads every byte as stream frames */
+			throw clientError("files can't be sent on a multiplexed client", ERROR_CLIENT_WRITE);
+		}
+		if (m_lean != NULL){
+			throw clientError("files can't be sent in lean mode", ERROR_CLIENT_WRITE);
+		}
+		if (!m_outbound.pushFile(fd, offset, len)){
+			throw clientError("can't queue file " + to_string(fd), ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return false;
+	}
+	if (m_blocking){
+		return flush();
+	}
+	return true;
+}
+
+bool client::flush(void callback(int32_t, void *), void * data){
+	try {
+		if (!m_connected){
+			throw clientError("trying to flush unconnected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		while (!m_outbound.empty()){
+			int32_t completedFd = -1;
+			int32_t ret = m_outbound.progress(m_socket, m_tlsMode ? m_ssl : NULL, &completedFd);
+			if (ret == -1){
+				throw clientError("error while sending file to server", ERROR_CLIENT_WRITE);
+			}
+			else if (ret == 1){
+				if (callback != NULL && completedFd != -1){
+					callback(completedFd, data);
+				}
+			}
+			else if (!m_blocking){
+				break;
+			}
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool client::flushMessages(){
+	while (m_outbound.frontIsMessage()){
+		int32_t ret = m_outbound.progress(m_socket, m_tlsMode ? m_ssl : NULL, NULL);
+		if (ret == -1){
+			return false;
+		}
+		else if (ret == 0 && !m_blocking){
+			break;
+		}
+	}
+	return true;
+}
+
+bool client::hasPendingOutput() const{
+	return !m_outbound.empty();
+}
+
+bool client::read(char buffer[MAX_BUFFER_SIZE], size_t * size){
 	try{
 		if (!m_connected){
 			throw clientError("trying to read on unconnected client", ERROR_CLIENT_UNCONNECTED);
 		}
+		if (m_lean != NULL){
+			size_t received;
+			if (!m_lean->read(buffer, &received)){
+				throw clientError("error while reading from client (lean)", ERROR_CLIENT_READ);
+			}
+			if (size != NULL){
+				*size = received;
+			}
+			return true;
+		}
+		/* the messages still queued may be the requests whose responses are awaited */
+		if (!m_outbound.empty() && !flushMessages()){
+			throw clientError("error while writing to client", ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	if (!m_early.empty()){
 		memset(buffer, 0, MAX_BUFFER_SIZE*sizeof(char));
-		if (m_tlsMode){
-			int ret;
-			if ((ret = SSL_read(m_ssl, buffer, MAX_BUFFER_SIZE)) <= 0){
-				int tmp = SSL_get_error(m_ssl, ret);
-				if (tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_READ){
-					throw clientError("error while reading from client (tls)", ERROR_CLIENT_READ);
+		size_t length = m_early.size() < MAX_BUFFER_SIZE ? m_early.size() : MAX_BUFFER_SIZE;
+		memcpy(buffer, m_early.data(), length);
+		m_early.erase(0, length);
+		if (size != NULL){
+			*size = length;
+		}
+		return true;
+	}
+	return receive(buffer, size);
+}
+
+bool client::receive(char buffer[MAX_BUFFER_SIZE], size_t * size){
+	try{
+		memset(buffer, 0, MAX_BUFFER_SIZE*sizeof(char));
+		char frame[MAX_BUFFER_SIZE + COMPRESSION_HEADER_SIZE];
+		char * target = m_compressed ? frame : buffer;
+		size_t targetSize = m_compressed ? sizeof(frame) : MAX_BUFFER_SIZE;
+		ssize_t received = 0;
+		if (size != NULL){
+			*size = 0;
+		}
+		/* a frame completed by a previous read is returned before reading more (which could block) */
+		bool buffered = m_compressed && compressionPool::frameSize(m_input.data(), m_input.size()) != 0;
+		if (!buffered){
+			if (m_tlsMode){
+				int ret;
+				if ((ret = SSL_read(m_ssl, target, targetSize)) <= 0){
+					int tmp = SSL_get_error(m_ssl, ret);
+					if (tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_READ){
+						throw clientError("error while reading from client (tls)", ERROR_CLIENT_READ);
+					}
+				}
+				else {
+					received = ret;
+				}
+			}
+			else {
+				if ((received = recv(m_socket, target, targetSize, 0)) == -1){
+					if (errno != EWOULDBLOCK){
+						throw clientError("error while reading from client (non-tls)", ERROR_CLIENT_READ);
+					}
+					received = 0;
 				}
 			}
 		}
+		if (m_compressed && (received > 0 || buffered)){
+			/* frames can be split between reads or share one, they are reassembled in m_input */
+			m_input.append(frame, received);
+			ssize_t length = compressionPool::frameSize(m_input.data(), m_input.size());
+			if (length < 0){
+				throw clientError("invalid compressed frame", ERROR_CLIENT_READ);
+			}
+			received = 0;
+			if (length > 0){
+				if ((received = m_compressionPool->decode(m_input.data(), length, buffer, MAX_BUFFER_SIZE)) < 0){
+					throw clientError("can't decode compressed message", ERROR_CLIENT_READ);
+				}
+				m_input.erase(0, length);
+			}
+		}
+		if (size != NULL){
+			*size = received;
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool client::negotiateCompression(){
+	char hello[COMPRESSION_HELLO_SIZE];
+	compressionPool::makeHello(hello, m_compressionPool->dictionaryId());
+	if (!write(hello, COMPRESSION_HELLO_SIZE)){
+		return false;
+	}
+	string following;
+	if (!waitForHello(COMPRESSION_HELLO_MAGIC, hello, following, COMPRESSION_NEGOTIATION_TIMEOUT)){
+		return false;
+	}
+	uint32_t dictionaryId = 0;
+	m_compressed = compressionPool::isHello(hello, COMPRESSION_HELLO_SIZE, &dictionaryId) && dictionaryId == m_compressionPool->dictionaryId();
+	/* the server compresses everything it sends after its answer */
+	if (m_compressed){
+		m_input = following;
+	}
+	else {
+		m_early.append(following);
+	}
+	return true;
+}
+
+bool client::negotiateMultiplexing(){
+	try {
+		char hello[MUX_HELLO_SIZE];
+		muxSession::makeHello(hello, MUX_VERSION);
+		if (!write(hello, MUX_HELLO_SIZE)){
+			return false;
+		}
+		string following;
+		if (!waitForHello(MUX_HELLO_MAGIC, hello, following, MUX_NEGOTIATION_TIMEOUT)){
+			return false;
+		}
+		uint32_t version = 0;
+		if (!muxSession::isHello(hello, MUX_HELLO_SIZE, &version) || version != MUX_VERSION){
+			throw clientError("server refused multiplexing", ERROR_CLIENT_CONNECT);
+		}
+		m_mux = new muxSession(true);
+		if (!following.empty() && !m_mux->consume(following.data(), following.size())){
+			throw clientError("invalid multiplexed frame", ERROR_CLIENT_READ);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool client::waitForHello(const char * magic, char hello[COMPRESSION_HELLO_SIZE], string& following, int32_t timeout){
+	int32_t waited = 0;
+	string received;
+	string pattern(magic, 4);
+	/* the compression and multiplexing answers have the same size */
+	memset(hello, 0, COMPRESSION_HELLO_SIZE);
+	while (waited < timeout){
+		size_t position = received.find(pattern);
+		if (position != string::npos && received.size() >= position + COMPRESSION_HELLO_SIZE){
+			memcpy(hello, received.data() + position, COMPRESSION_HELLO_SIZE);
+			m_early.append(received, 0, position);
+			following = received.substr(position + COMPRESSION_HELLO_SIZE);
+			return true;
+		}
+		struct pollfd pfd;
+		pfd.fd = m_socket;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		bool buffered = (m_tlsMode && SSL_pending(m_ssl) > 0) || (m_compressed && compressionPool::frameSize(m_input.data(), m_input.size()) > 0);
+		if (buffered || poll(&pfd, 1, 10) > 0){
+			char buffer[MAX_BUFFER_SIZE];
+			size_t size = 0;
+			if (!receive(buffer, &size)){
+				return false;
+			}
+			received.append(buffer, size);
+		}
 		else {
-			if (recv(m_socket, buffer, MAX_BUFFER_SIZE, 0) == -1 && errno != EWOULDBLOCK){
-				throw clientError("error while reading from client (non-tls)", ERROR_CLIENT_READ);
+			waited += 10;
+		}
+	}
+	/* no answer, what was received is data for the application */
+	m_early.append(received);
+	return true;
+}
+
+bool client::isMultiplexed() const{
+	return m_mux != NULL;
+}
+
+uint32_t client::openStream(){
+	if (m_mux == NULL){
+		return 0;
+	}
+	return m_mux->openStream();
+}
+
+bool client::writeToStream(uint32_t stream, const char * buffer, size_t size){
+	try {
+		if (!m_connected || m_mux == NULL){
+			throw clientError("trying to write to a stream on an unconnected or non multiplexed client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if (!m_mux->queue(stream, buffer, size)){
+			throw clientError("invalid message size " + to_string(size), ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return false;
+	}
+	return flushStreams();
+}
+
+bool client::readFromStreams(uint32_t * stream, char buffer[MAX_BUFFER_SIZE], size_t * size){
+	try {
+		if (!m_connected || m_mux == NULL){
+			throw clientError("trying to read from streams on an unconnected or non multiplexed client", ERROR_CLIENT_UNCONNECTED);
+		}
+		memset(buffer, 0, MAX_BUFFER_SIZE*sizeof(char));
+		size_t received = 0;
+		if (size != NULL){
+			*size = 0;
+		}
+		if (!m_early.empty()){
+			/* received before multiplexing was negociated, it belongs to no stream */
+			*stream = 0;
+			return read(buffer, size);
+		}
+		if (!m_mux->next(stream, buffer, &received)){
+			char frames[MAX_BUFFER_SIZE];
+			size_t framesSize = 0;
+			if (!read(frames, &framesSize)){
+				return false;
+			}
+			if (framesSize > 0 && !m_mux->consume(frames, framesSize)){
+				throw clientError("invalid multiplexed frame", ERROR_CLIENT_READ);
 			}
+			m_mux->next(stream, buffer, &received);
+		}
+		if (size != NULL){
+			*size = received;
 		}
 	}
 	catch (const clientError& error){
@@ -172,5 +679,43 @@ bool client::read(char buffer[MAX_BUFFER_SIZE]){
 		disconnect();
 		return false;
 	}
+	/* sends the credit given back for the message and the frames which were waiting for credit */
+	return flushStreams();
+}
+
+size_t client::bufferedStreamMessages() const{
+	if (m_mux == NULL){
+		return 0;
+	}
+	return m_mux->received();
+}
+
+bool client::closeStream(uint32_t stream){
+	if (m_mux == NULL){
+		return false;
+	}
+	m_mux->close(stream);
+	return flushStreams();
+}
+
+bool client::flushStreams(){
+	if (!m_outbound.empty() && !flushMessages()){
+		try {
+			throw clientError("error while writing to client", ERROR_CLIENT_WRITE);
+		}
+		catch (const clientError& error){
+			error.outputMessage();
+			disconnect();
+		}
+		return false;
+	}
+	char frames[MAX_BUFFER_SIZE];
+	size_t size;
+	/* frames stay in the streams while the socket is full, so the queue only holds what the socket refused */
+	while (m_mux != NULL && m_outbound.empty() && (size = m_mux->produce(frames, sizeof(frames))) > 0){
+		if (!write(frames, size)){
+			return false;
+		}
+	}
 	return true;
 }
@@ -9,13 +9,30 @@
 #include <signal.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <stddef.h>
+#include <poll.h>
 
 
 #include <string>
 
 #include "error.hpp"
+#include "../server/outbound.hpp"
+#include "../server/compression.hpp"
+#include "../server/mux.hpp"
+#include "resolver.hpp"
+#include "basic_client.hpp"
 
 #define MAX_BUFFER_SIZE 8192
+#define COMPRESSION_NEGOTIATION_TIMEOUT 1000
+#define MUX_NEGOTIATION_TIMEOUT 1000
+#define RESOLVE_TIMEOUT 5000
+/* ms connect waits for the resolution of the server name
+ */
+#define HAPPY_EYEBALLS_DELAY 250
+/* ms before connect tries the next address of the server while the previous attempts are still running
+ */
+#define CONNECT_TIMEOUT 10000
 
 class client
 {
@@ -24,14 +41,38 @@ public:
 	/*
 	 * tlsMode : true if tls connection should be enabled
 	 * blocking : true if client should be on blocking mode
-	 * serverIP_URL : string containing the ip or url of the server
-	 * serverPort : string containing the port of the server
+	 * serverIP_URL : string containing the ip (v4 or v6) or url of the server, urls are resolved in the background (see resolver.hpp)
+	 *   "unix:/path/to/socket" connects to a unix domain socket, "unix:@name" to a socket of the abstract namespace
+	 * serverPort : string containing the port of the server (ignored for unix domain sockets)
 	 * pathToCAFile : if tlsMode is true, this specifies a certificate which will be trusted by the client
 	 * checkServer : true if server key should be checked
 	 */
 	~client();
+	bool enableCompression(const std::string& pathToDictionary = "", int32_t level = 3, uint32_t threshold = 128);
+	/* asks the server for zstd compression of messages on the next connect (requires a build with TLS_USE_ZSTD)
+	 * pathToDictionary : shared dictionary, the server must use the same one (empty for no dictionary)
+	 * level : zstd compression level
+	 * threshold : messages smaller than threshold bytes are sent uncompressed
+	 * returns true on success, false otherwise
+	 */
+	void enableMultiplexing();
+	/* asks the server to multiplex streams on the next connect, the server must call enableMultiplexing too
+	 */
+	void setLeanMode(bool lean);
+	/* lean : connect, write and read go through the basic_client specialized for the tls and blocking modes (see basic_client.hpp)
+	 * writes are made in place without outbound queue, so files can't be sent, and connect fails if compression or multiplexing is enabled
+	 * it must be called before connect
+	 */
+	bool resolved();
+	/* returns true once the address of the server is known, connect doesn't wait for the resolution then
+	 */
 	bool connect();
 	/* this function tries to establish a connection to the server
+	 * the server name is resolved again if its cached addresses have expired (waiting at most RESOLVE_TIMEOUT ms)
+	 * when it has several addresses they are tried HAPPY_EYEBALLS_DELAY ms apart without waiting for the previous attempts to fail,
+	 * the first connection established is kept
+	 * if compression is enabled, it is negociated with the server (waiting at most COMPRESSION_NEGOTIATION_TIMEOUT ms for its answer)
+	 * if multiplexing is enabled, it is negociated the same way (MUX_NEGOTIATION_TIMEOUT ms), connect fails if the server refuses it
 	 * returns true on success, false otherwise
 	 */
 	void disconnect();
@@ -41,21 +82,103 @@ public:
 	/* write data to server
 	 * returns true on success, false otherwise
 	 */
-	bool read(char buffer[MAX_BUFFER_SIZE]);
+	bool write(const char * buffer, size_t size);
+	/* write size bytes of buffer to server (buffer may contain null bytes)
+	 * if a file or an older message is still being sent, the message is queued behind it and sent by flush or by the next writes
+	 * the bytes the socket doesn't take right away are queued the same way
+	 * returns true on success, false otherwise
+	 */
+	bool sendFile(int32_t fd, off_t offset = 0, size_t len = 0);
+	/* sends len bytes of the file fd starting at offset to the server (len 0 sends up to the end of the file)
+	 * in blocking mode the whole file is sent before returning
+	 * in non-blocking mode the transfer is queued and made by flush, fd must stay open until it is completed
+	 * the bytes of the file are sent as they are, so it fails once compression or multiplexing is negociated
+	 * returns true on success, false otherwise
+	 */
+	bool flush(void callback(int32_t, void *) = NULL, void * data = NULL);
+	/* sends as much queued data as possible
+	 * callback (if not NULL) is called with the file descriptor and data each time a file transfer is completed
+	 * returns true on success, false otherwise
+	 */
+	bool hasPendingOutput() const;
+	/* returns true if some data is waiting to be sent
+	 */
+	bool read(char buffer[MAX_BUFFER_SIZE], size_t * size = NULL);
 	/* read data from server
+	 * if size is not NULL the number of bytes stored in buffer is written in it
+	 * returns true on success, false otherwise
+	 */
+	bool isCompressed() const;
+	/* returns true if compression has been negociated with the server
+	 */
+	bool isMultiplexed() const;
+	/* returns true if multiplexing has been negociated with the server
+	 */
+	uint32_t openStream();
+	/* returns the id of a new stream (0 if multiplexing isn't negociated), opening a stream doesn't send anything
+	 */
+	bool writeToStream(uint32_t stream, const char * buffer, size_t size);
+	/* queues size bytes of buffer (at most MUX_MAX_MESSAGE_SIZE) on stream and sends as many frames as the streams credit allows
+	 * frames which can't be sent yet are sent by the next call to writeToStream or readFromStreams
+	 * returns true on success, false otherwise
+	 */
+	bool readFromStreams(uint32_t * stream, char buffer[MAX_BUFFER_SIZE], size_t * size = NULL);
+	/* reads data from server and stores the next complete message in buffer and its stream in stream
+	 * if size is not NULL the size of the message (0 if no message is complete yet) is written in it
+	 * returns true on success, false otherwise
+	 */
+	size_t bufferedStreamMessages() const;
+	/* returns the number of complete messages already received, readFromStreams returns them without reading from the server
+	 */
+	bool closeStream(uint32_t stream);
+	/* drops the messages queued on stream and tells the server
 	 * returns true on success, false otherwise
 	 */
 private:
+	bool negotiateCompression();
+	bool negotiateMultiplexing();
+	bool flushMessages();
+	/* sends the messages at the head of the outbound queue, stops at the first file
+	 */
+	bool receive(char buffer[MAX_BUFFER_SIZE], size_t * size);
+	/* same as read without the bytes kept in m_early
+	 */
+	bool waitForHello(const char * magic, char hello[COMPRESSION_HELLO_SIZE], std::string& following, int32_t timeout);
+	/* reads until the answer of the server starting with magic is received (at most timeout ms) and stores it in hello
+	 * the bytes received before it are kept in m_early, the ones received after it are stored in following
+	 * returns false on error, hello is zeroed if the server didn't answer
+	 */
+	bool flushStreams();
+	int32_t raceConnect(const std::vector<resolvedAddress>& addresses);
 	int32_t m_socket;
 	bool m_tlsMode;
 	bool m_blocking;
 	bool m_resolveHostname;
 	bool m_connected;
 	bool m_checkServer;
-	struct sockaddr_in m_serverAddress;
+	std::string m_host;
+	std::string m_port;
+	/* empty for unix domain sockets
+	 */
+	struct sockaddr_storage m_serverAddress;
+	socklen_t m_serverAddressLength;
 	std::string m_pathToCAFile;
 	SSL_CTX * m_sslContext;
 	SSL * m_ssl;
+	outboundQueue m_outbound;
+	compressionPool * m_compressionPool;
+	std::string m_input;
+	/* bytes of compressed frames not complete yet or not returned yet
+	 */
+	std::string m_early;
+	/* bytes received before the answer of a negotiation, returned by the next reads
+	 */
+	bool m_compressed;
+	bool m_multiplexing;
+	muxSession * m_mux;
+	specializedClient * m_lean;
+	/* allocated by setLeanMode, NULL otherwise
+	 */
 };
 
 #endif /* CLIENT_HPP */
@@ -0,0 +1,16 @@
+#ifndef CLIENT_CLOCK_HPP
+#define CLIENT_CLOCK_HPP
+
+#include <time.h>
+
+#include <cstdint>
+
+/* returns the time of the monotonic clock in microseconds, used for the deadlines of the client classes
+ */
+inline uint64_t monotonicNow(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif /* CLIENT_CLOCK_HPP */
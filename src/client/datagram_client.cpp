@@ -0,0 +1,240 @@
+#include "datagram_client.hpp"
+
+using namespace std;
+
+datagramClient::datagramClient(bool dtlsMode, bool blocking, string serverIP_URL, string serverPort, string pathToCAFile, bool checkServer) : m_socket(-1), m_dtlsMode(dtlsMode), m_blocking(blocking), m_resolveHostname(false), m_connected(false), m_checkServer(checkServer), m_pathToCAFile(pathToCAFile), m_sslContext(NULL), m_batch(NULL), m_session(NULL), m_received(0), m_next(0){
+	if (dtlsMode){
+		SSL_library_init();
+	}
+	memset(&m_serverAddress, 0, sizeof(m_serverAddress));
+	m_serverAddressLength = 0;
+	struct addrinfo * res;
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(serverIP_URL.c_str(), serverPort.c_str(), &hints, &res) == 0){
+		m_resolveHostname = true;
+		memcpy(&m_serverAddress, res->ai_addr, res->ai_addrlen);
+		m_serverAddressLength = res->ai_addrlen;
+		freeaddrinfo(res);
+	}
+}
+
+datagramClient::~datagramClient(){
+	disconnect();
+}
+
+bool datagramClient::connect(){
+	try {
+		if (!m_resolveHostname){
+			throw clientError("host unreachable", ERROR_CLIENT_RESOLVE_HOSTNAME);
+		}
+		if (m_connected){
+			throw clientError("trying to connect with an already connected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if ((m_socket = socket(m_serverAddress.ss_family, SOCK_DGRAM, 0)) == -1){
+			throw clientError("can't create socket", ERROR_CLIENT_CONNECT);
+		}
+		if (!m_blocking){
+			int options;
+			if ((options = fcntl(m_socket, F_GETFL)) == -1){
+				throw clientError("fcntl error", ERROR_CLIENT_CONNECT);
+			}
+			if (fcntl(m_socket, F_SETFL, options | O_NONBLOCK) == -1){
+				throw clientError("fcntl error", ERROR_CLIENT_CONNECT);
+			}
+		}
+		/* a connected udp socket only receives datagrams from the server */
+		if (::connect(m_socket, (struct sockaddr*)&m_serverAddress, m_serverAddressLength) != 0){
+			throw clientError("can't connect to server", ERROR_CLIENT_CONNECT);
+		}
+		m_batch = new datagramBatch();
+		m_session = new datagramSession(m_batch, m_socket, NULL, 0);
+		m_received = 0;
+		m_next = 0;
+		if (m_dtlsMode){
+			if ((m_sslContext = SSL_CTX_new(DTLS_client_method())) == NULL){
+				throw clientError("can't create SSL_CTX", ERROR_CLIENT_CONNECT);
+			}
+			if (SSL_CTX_set_min_proto_version(m_sslContext, DTLS1_2_VERSION) == 0){
+				throw clientError("SSL_CTX_set_min_proto_version error", ERROR_CLIENT_CONNECT);
+			}
+			if (m_checkServer){
+				if (SSL_CTX_load_verify_locations(m_sslContext, m_pathToCAFile.c_str(), NULL) != 1){
+					throw clientError("can't load file " + m_pathToCAFile, ERROR_CLIENT_CONNECT);
+				}
+				SSL_CTX_set_verify(m_sslContext, SSL_VERIFY_PEER, NULL);
+				SSL_CTX_set_verify_depth(m_sslContext, 1);
+			}
+			else {
+				SSL_CTX_set_verify(m_sslContext, SSL_VERIFY_NONE, NULL);
+			}
+			if (!m_session->secure(m_sslContext, false)){
+				throw clientError("can't create SSL", ERROR_CLIENT_CONNECT);
+			}
+			int32_t waited = 0;
+			int32_t ret = m_session->handshake();
+			char buffer[MAX_BUFFER_SIZE];
+			while (ret == 0 && waited < DATAGRAM_HANDSHAKE_TIMEOUT){
+				if (!m_batch->flush(m_socket)){
+					throw clientError("can't send handshake", ERROR_CLIENT_CONNECT);
+				}
+				struct pollfd pfd;
+				pfd.fd = m_socket;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				if (poll(&pfd, 1, 10) <= 0){
+					waited += 10;
+					ret = m_session->handshake();
+					continue;
+				}
+				if ((m_received = m_batch->receive(m_socket, false)) == -1){
+					throw clientError("can't receive handshake", ERROR_CLIENT_CONNECT);
+				}
+				/* the datagrams following the end of the handshake are kept for read */
+				for (m_next = 0; m_next < m_received && ret == 0;){
+					size_t size = 0;
+					const char * datagram = m_batch->datagram(m_next++, &size, NULL, NULL);
+					if (datagram != NULL && m_session->input(datagram, size, buffer, sizeof(buffer)) == -1){
+						ret = -1;
+					}
+					else if (m_session->handshakeMade()){
+						ret = 1;
+					}
+				}
+			}
+			if (ret != 1){
+				throw clientError("DTLS handshake error", ERROR_CLIENT_CONNECT);
+			}
+			m_batch->flush(m_socket);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	m_connected = true;
+	return true;
+}
+
+void datagramClient::disconnect(){
+	if (m_session != NULL){
+		m_session->close();
+		m_batch->flush(m_socket);
+		delete m_session;
+		m_session = NULL;
+	}
+	if (m_batch != NULL){
+		delete m_batch;
+		m_batch = NULL;
+	}
+	if (m_socket != -1){
+		close(m_socket);
+		m_socket = -1;
+	}
+	if (m_sslContext != NULL){
+		SSL_CTX_free(m_sslContext);
+		m_sslContext = NULL;
+	}
+	m_received = 0;
+	m_next = 0;
+	m_connected = false;
+}
+
+bool datagramClient::write(char const buffer[MAX_BUFFER_SIZE]){
+	return write(buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+}
+
+bool datagramClient::write(const char * buffer, size_t size){
+	try {
+		if (!m_connected){
+			throw clientError("trying to write on unconnected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if (size > MAX_BUFFER_SIZE){
+			size = MAX_BUFFER_SIZE;
+		}
+		if (!m_session->output(buffer, size)){
+			throw clientError("error while writing to server (datagram)", ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool datagramClient::flush(){
+	try {
+		if (!m_connected){
+			throw clientError("trying to flush unconnected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if (!m_batch->flush(m_socket)){
+			throw clientError("error while sending datagrams", ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool datagramClient::read(char buffer[MAX_BUFFER_SIZE], size_t * size){
+	try {
+		if (!m_connected){
+			throw clientError("trying to read on unconnected client", ERROR_CLIENT_UNCONNECTED);
+		}
+		memset(buffer, 0, MAX_BUFFER_SIZE*sizeof(char));
+		if (size != NULL){
+			*size = 0;
+		}
+		if (m_batch->queued() != 0 && !m_batch->flush(m_socket)){
+			throw clientError("error while sending datagrams", ERROR_CLIENT_WRITE);
+		}
+		while (true){
+			if (m_next >= m_received){
+				m_next = 0;
+				if ((m_received = m_batch->receive(m_socket, m_blocking)) == -1){
+					m_received = 0;
+					throw clientError("error while reading from server (datagram)", ERROR_CLIENT_READ);
+				}
+				if (m_received == 0 && !m_blocking){
+					break;
+				}
+			}
+			size_t datagramSize = 0;
+			const char * datagram = m_batch->datagram(m_next++, &datagramSize, NULL, NULL);
+			if (datagram == NULL){
+				continue;
+			}
+			ssize_t received = m_session->input(datagram, datagramSize, buffer, MAX_BUFFER_SIZE);
+			if (received == -1){
+				throw clientError("error while reading from server (dtls)", ERROR_CLIENT_READ);
+			}
+			if (received > 0){
+				if (size != NULL){
+					*size = received;
+				}
+				break;
+			}
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+uint64_t datagramClient::droppedDatagrams() const{
+	if (m_batch == NULL){
+		return 0;
+	}
+	return m_batch->dropped();
+}
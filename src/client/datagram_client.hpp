@@ -0,0 +1,81 @@
+#ifndef DATAGRAM_CLIENT_HPP
+#define DATAGRAM_CLIENT_HPP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <openssl/ssl.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include <string>
+
+#include "error.hpp"
+#include "../server/datagram.hpp"
+
+#define MAX_BUFFER_SIZE 8192
+#define DATAGRAM_HANDSHAKE_TIMEOUT 5000
+
+/* this class is the client side of datagramServer : messages are sent in udp datagrams, optionally cyphered with dtls
+ * datagrams may be lost or reordered, nothing is retransmitted
+ */
+class datagramClient
+{
+public:
+	datagramClient(bool dtlsMode, bool blocking, std::string serverIP_URL, std::string serverPort, std::string pathToCAFile = "", bool checkServer = false);
+	/*
+	 * dtlsMode : true if datagrams should be cyphered with dtls
+	 * blocking : true if read should wait for a message
+	 * serverIP_URL : string containing the ip (v4 or v6) or url of the server
+	 * serverPort : string containing the port of the server
+	 * pathToCAFile : if dtlsMode is true, this specifies a certificate which will be trusted by the client
+	 * checkServer : true if server key should be checked
+	 */
+	~datagramClient();
+	bool connect();
+	/* connects the socket to the server, in dtls mode the handshake is made (waiting at most DATAGRAM_HANDSHAKE_TIMEOUT ms)
+	 * returns true on success, false otherwise
+	 */
+	void disconnect();
+	/* disconnect client
+	 */
+	bool write(char const buffer[MAX_BUFFER_SIZE]);
+	bool write(const char * buffer, size_t size);
+	/* queues a message of size bytes, messages are sent by flush (or when DATAGRAM_BATCH_SIZE messages are queued)
+	 * returns true on success, false otherwise
+	 */
+	bool flush();
+	/* sends every queued message with one system call
+	 * returns true on success, false otherwise
+	 */
+	bool read(char buffer[MAX_BUFFER_SIZE], size_t * size = NULL);
+	/* flushes the queued messages and reads the next message from the server (nothing is read if size is 0 in non-blocking mode)
+	 * datagrams are received by batches, the following calls return the messages already received
+	 * if size is not NULL the number of bytes stored in buffer is written in it
+	 * returns true on success, false otherwise
+	 */
+	uint64_t droppedDatagrams() const;
+	/* returns the number of datagrams which couldn't be sent
+	 */
+private:
+	int32_t m_socket;
+	bool m_dtlsMode;
+	bool m_blocking;
+	bool m_resolveHostname;
+	bool m_connected;
+	bool m_checkServer;
+	struct sockaddr_storage m_serverAddress;
+	socklen_t m_serverAddressLength;
+	std::string m_pathToCAFile;
+	SSL_CTX * m_sslContext;
+	datagramBatch * m_batch;
+	datagramSession * m_session;
+	int32_t m_received;
+	int32_t m_next;
+	/* datagrams of the last batch received which haven't been read yet
+	 */
+};
+
+#endif /* DATAGRAM_CLIENT_HPP */
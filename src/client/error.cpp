@@ -20,6 +20,12 @@ clientError::clientError(const std::string& s, uint16_t errorType) : m_errorType
 	else if (m_errorType == ERROR_CLIENT_UNCONNECTED){
 		errorMessage += "client is not connected";
 	}
+	else if (m_errorType == ERROR_CLIENT_COMPRESSION){
+		errorMessage += "error while setting up compression";
+	}
+	else if (m_errorType == ERROR_CLIENT_REPLAY){
+		errorMessage += "error while replaying a capture";
+	}
 	else {
 		errorMessage += "unknown error";
 	}
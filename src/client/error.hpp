@@ -1,5 +1,5 @@
-#ifndef ERROR_HPP
-#define ERROR_HPP
+#ifndef CLIENT_ERROR_HPP
+#define CLIENT_ERROR_HPP
 
 #include <unistd.h>
 #include <string.h>
@@ -9,9 +9,15 @@
 
 #define ERROR_CLIENT_RESOLVE_HOSTNAME 1
 #define ERROR_CLIENT_CONNECT 2
+#ifndef ERROR_CLIENT_WRITE
 #define ERROR_CLIENT_WRITE 3
+#endif
+/* server/error.hpp defines it too (8), the header included first gives its value
+ */
 #define ERROR_CLIENT_READ 4
 #define ERROR_CLIENT_UNCONNECTED 5
+#define ERROR_CLIENT_COMPRESSION 6
+#define ERROR_CLIENT_REPLAY 9
 
 /* this class handles error output for the client class
  */
@@ -28,4 +34,4 @@ private:
 	uint32_t errtmp;
 };
 
-#endif /* ERROR_HPP */
+#endif /* CLIENT_ERROR_HPP */
@@ -0,0 +1,235 @@
+#include "replay.hpp"
+
+using namespace std;
+
+replayDriver::replayDriver(bool tlsMode, string serverIP_URL, string serverPort, string pathToCAFile, bool checkServer) : m_tlsMode(tlsMode), m_host(serverIP_URL), m_port(serverPort), m_pathToCAFile(pathToCAFile), m_checkServer(checkServer), m_fd(-1), m_map(NULL), m_size(0), m_sent(0), m_expected(0), m_received(0), m_failed(0), m_maxLag(0){
+
+}
+
+replayDriver::~replayDriver(){
+	while (!m_clients.empty()){
+		drop(m_clients.begin(), false);
+	}
+	close();
+}
+
+bool replayDriver::open(const string& path){
+	close();
+	try {
+		if ((m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC)) == -1){
+			throw clientError("can't open capture file " + path, ERROR_CLIENT_REPLAY);
+		}
+		struct stat status;
+		if (fstat(m_fd, &status) != 0 || (uint64_t)status.st_size < sizeof(captureHeader)){
+			throw clientError("capture file " + path + " is too small", ERROR_CLIENT_REPLAY);
+		}
+		m_size = status.st_size;
+		void * map = mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+		if (map == MAP_FAILED){
+			throw clientError("can't map capture file " + path, ERROR_CLIENT_REPLAY);
+		}
+		m_map = (char *)map;
+		const captureHeader * header = (const captureHeader *)m_map;
+		if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAPTURE_VERSION){
+			throw clientError(path + " isn't a capture file", ERROR_CLIENT_REPLAY);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool replayDriver::run(double speed){
+	if (m_map == NULL){
+		return false;
+	}
+	const captureHeader * header = (const captureHeader *)m_map;
+	const char * data = m_map + sizeof(captureHeader);
+	/* records written after open are outside of the mapping, the acquire load pairs with the release store of captureLog::append */
+	uint64_t used = __atomic_load_n(&header->used, __ATOMIC_ACQUIRE);
+	if (used > m_size - sizeof(captureHeader)){
+		used = m_size - sizeof(captureHeader);
+	}
+	const captureRecord * record;
+	const char * message;
+	uint64_t position = 0;
+	/* clients are multiplexed from their connect, so streams are looked for first */
+	m_multiplexed.clear();
+	while (captureLog::next(data, used, &position, &record, &message)){
+		if (record->stream != 0){
+			m_multiplexed.insert(record->connection);
+		}
+	}
+	position = 0;
+	uint64_t start = monotonicNow();
+	while (captureLog::next(data, used, &position, &record, &message)){
+		uint64_t now = monotonicNow();
+		uint64_t due = speed > 0 ? start + (uint64_t)(record->timestamp / speed) : now;
+		while (now < due){
+			receive();
+			now = monotonicNow();
+			if (now < due){
+				usleep(due - now < REPLAY_MAX_SLEEP ? due - now : REPLAY_MAX_SLEEP);
+				now = monotonicNow();
+			}
+		}
+		if (now - due > m_maxLag){
+			m_maxLag = now - due;
+		}
+		play(record, message);
+	}
+	uint64_t deadline = monotonicNow() + (uint64_t)REPLAY_DRAIN_TIMEOUT * 1000;
+	while (m_received < m_expected && !m_clients.empty() && monotonicNow() < deadline){
+		receive();
+		usleep(REPLAY_MAX_SLEEP);
+	}
+	while (!m_clients.empty()){
+		drop(m_clients.begin(), false);
+	}
+	if (position != used){
+		try {
+			throw clientError("truncated record at " + to_string(position) + " in the capture", ERROR_CLIENT_REPLAY);
+		}
+		catch (const clientError& error){
+			error.outputMessage();
+		}
+		return false;
+	}
+	return true;
+}
+
+uint64_t replayDriver::sentMessages() const{
+	return m_sent;
+}
+
+uint64_t replayDriver::expectedBytes() const{
+	return m_expected;
+}
+
+uint64_t replayDriver::receivedBytes() const{
+	return m_received;
+}
+
+uint64_t replayDriver::failedConnections() const{
+	return m_failed;
+}
+
+uint64_t replayDriver::maxLag() const{
+	return m_maxLag;
+}
+
+void replayDriver::close(){
+	if (m_map != NULL){
+		munmap(m_map, m_size);
+		m_map = NULL;
+	}
+	if (m_fd != -1){
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_size = 0;
+}
+
+void replayDriver::play(const captureRecord * record, const char * message){
+	if (record->type == CAPTURE_ACCEPT){
+		replayed r;
+		r.expected = 0;
+		r.received = 0;
+		r.kicked = false;
+		r.c = new client(m_tlsMode, false, m_host, m_port, m_pathToCAFile, m_checkServer);
+		if (m_multiplexed.find(record->connection) != m_multiplexed.end()){
+			r.c->enableMultiplexing();
+		}
+		if (!r.c->connect()){
+			delete r.c;
+			m_failed++;
+			return;
+		}
+		m_clients[record->connection] = r;
+		return;
+	}
+	auto i = m_clients.find(record->connection);
+	if (i == m_clients.end() || i->second.kicked){
+		/* its connect failed, it is only waiting for its responses or the capture started after its accept */
+		return;
+	}
+	replayed& r = i->second;
+	if (record->type == CAPTURE_READ){
+		bool written;
+		if (r.c->isMultiplexed() && record->stream != 0){
+			auto s = r.streams.find(record->stream);
+			if (s == r.streams.end()){
+				s = r.streams.insert(make_pair(record->stream, r.c->openStream())).first;
+			}
+			written = r.c->writeToStream(s->second, message, record->size);
+		}
+		else {
+			written = r.c->write(message, record->size);
+		}
+		/* the client queues what the socket doesn't take, a successful write has sent the message or will send it */
+		if (!written){
+			drop(i, true);
+			return;
+		}
+		m_sent++;
+	}
+	else if (record->type == CAPTURE_WRITE){
+		r.expected += record->size;
+		m_expected += record->size;
+	}
+	else if (record->type == CAPTURE_KICK){
+		r.kicked = true;
+		if (r.received >= r.expected){
+			drop(i, false);
+		}
+	}
+}
+
+void replayDriver::receive(){
+	for (auto i = m_clients.begin(); i != m_clients.end();){
+		auto current = i++;
+		if (!receive(current->second)){
+			/* the capture ended this connection too, it only fails if responses are missing */
+			drop(current, !current->second.kicked || current->second.received < current->second.expected);
+		}
+		else if (current->second.kicked && current->second.received >= current->second.expected){
+			drop(current, false);
+		}
+	}
+}
+
+bool replayDriver::receive(replayed& r){
+	char buffer[MAX_BUFFER_SIZE];
+	size_t size = 0;
+	if (r.c->isMultiplexed()){
+		uint32_t stream;
+		do {
+			if (!r.c->readFromStreams(&stream, buffer, &size)){
+				return false;
+			}
+			r.received += size;
+			m_received += size;
+		} while (size > 0);
+	}
+	else {
+		do {
+			if (!r.c->read(buffer, &size)){
+				return false;
+			}
+			r.received += size;
+			m_received += size;
+		} while (size > 0);
+	}
+	return true;
+}
+
+void replayDriver::drop(map<uint64_t, replayed>::iterator i, bool failed){
+	delete i->second.c;
+	if (failed){
+		m_failed++;
+	}
+	m_clients.erase(i);
+}
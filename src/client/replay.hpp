@@ -0,0 +1,102 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+#include <set>
+
+#include "error.hpp"
+#include "client.hpp"
+#include "../server/capture.hpp"
+#include "clock.hpp"
+
+#define REPLAY_DRAIN_TIMEOUT 1000
+/* ms run keeps reading responses after the last record while some are still expected
+ */
+#define REPLAY_MAX_SLEEP 1000
+/* us run sleeps at most between two reads of the responses while waiting for the next record
+ */
+
+/* this class plays a capture written by server::enableCapture against a server through client connections
+ * each captured connection gets a non-blocking client : accepts connect it, reads are sent again (or queued by the client until the socket takes them),
+ * writes count the bytes the server is expected to answer and kicks disconnect it once these bytes are received
+ * connections which used streams are multiplexed and send their messages on streams opened in the same order
+ */
+class replayDriver
+{
+public:
+	replayDriver(bool tlsMode, std::string serverIP_URL, std::string serverPort, std::string pathToCAFile = "", bool checkServer = false);
+	/* the arguments are given to the clients (see client::client)
+	 */
+	~replayDriver();
+	bool open(const std::string& path);
+	/* maps the capture file path, which may still be written by a server
+	 * returns true on success, false otherwise
+	 */
+	bool run(double speed = 1.0);
+	/* plays the records of the capture, at their original pace for speed 1.0, speed times faster otherwise
+	 * (0 plays them as fast as possible, messages which aren't multiplexed may then reach the server together)
+	 * and disconnects every client at the end
+	 * responses are read while waiting for the next record, then during REPLAY_DRAIN_TIMEOUT ms at most
+	 * returns false if the capture isn't opened or is truncated, connection errors only count in failedConnections
+	 */
+	uint64_t sentMessages() const;
+	/* returns the number of messages sent again
+	 */
+	uint64_t expectedBytes() const;
+	/* returns the number of bytes the server wrote during the capture to the connections replayed
+	 */
+	uint64_t receivedBytes() const;
+	/* returns the number of bytes received from the server during the replay
+	 */
+	uint64_t failedConnections() const;
+	/* returns the number of captured connections which couldn't be replayed up to their end
+	 */
+	uint64_t maxLag() const;
+	/* returns the largest delay in us between the time a record was due and the time it was played
+	 */
+private:
+	struct replayed
+	{
+		client * c;
+		std::map<uint32_t, uint32_t> streams;
+		/* captured stream id to stream id of the client
+		 */
+		uint64_t expected;
+		uint64_t received;
+		bool kicked;
+		/* the capture has ended, the client is disconnected once its responses are received
+		 */
+	};
+	void close();
+	void play(const captureRecord * record, const char * message);
+	void receive();
+	/* reads the responses of every client, dropping the failed ones
+	 */
+	bool receive(replayed& r);
+	void drop(std::map<uint64_t, replayed>::iterator i, bool failed);
+	bool m_tlsMode;
+	std::string m_host;
+	std::string m_port;
+	std::string m_pathToCAFile;
+	bool m_checkServer;
+	int32_t m_fd;
+	char * m_map;
+	uint64_t m_size;
+	std::map<uint64_t, replayed> m_clients;
+	std::set<uint64_t> m_multiplexed;
+	uint64_t m_sent;
+	uint64_t m_expected;
+	uint64_t m_received;
+	uint64_t m_failed;
+	uint64_t m_maxLag;
+};
+
+#endif /* REPLAY_HPP */
@@ -0,0 +1,183 @@
+#include "resolver.hpp"
+
+using namespace std;
+
+resolver::resolver() : m_ttl((uint64_t)RESOLVER_DEFAULT_TTL * 1000000){
+
+}
+
+resolver& resolver::shared(){
+	static resolver * instance = new resolver();
+	return *instance;
+}
+
+void resolver::setTtl(uint32_t ttl){
+	lock_guard<mutex> lock(m_mutex);
+	m_ttl = (uint64_t)ttl * 1000000;
+}
+
+void resolver::request(const string& host, const string& port){
+	lock_guard<mutex> lock(m_mutex);
+	find(host, port);
+}
+
+int32_t resolver::lookup(const string& host, const string& port, vector<resolvedAddress>& addresses){
+	lock_guard<mutex> lock(m_mutex);
+	return status(find(host, port), addresses);
+}
+
+int32_t resolver::wait(const string& host, const string& port, int32_t timeout, vector<resolvedAddress>& addresses){
+	uint64_t deadline = monotonicNow() + (uint64_t)timeout * 1000;
+	unique_lock<mutex> lock(m_mutex);
+	int32_t ret;
+	while ((ret = status(find(host, port), addresses)) == RESOLVER_PENDING){
+		uint64_t now = monotonicNow();
+		if (now >= deadline){
+			break;
+		}
+		m_resolved.wait_for(lock, chrono::microseconds(deadline - now));
+	}
+	return ret;
+}
+
+void resolver::invalidate(const string& host, const string& port){
+	lock_guard<mutex> lock(m_mutex);
+	auto i = m_entries.find(host + " " + port);
+	if (i != m_entries.end()){
+		if (cancel(i->second)){
+			delete i->second;
+		}
+		m_entries.erase(i);
+	}
+}
+
+void resolver::notify(union sigval value){
+	resolver * r = (resolver *)value.sival_ptr;
+	/* taking the mutex makes sure a thread checking the query in wait is already waiting */
+	lock_guard<mutex> lock(r->m_mutex);
+	r->m_resolved.notify_all();
+}
+
+int32_t resolver::status(entry * e, vector<resolvedAddress>& addresses){
+	if (e->query != NULL){
+		return RESOLVER_PENDING;
+	}
+	if (e->failed){
+		return RESOLVER_FAILED;
+	}
+	addresses = e->addresses;
+	return RESOLVER_DONE;
+}
+
+resolver::entry * resolver::find(const string& host, const string& port){
+	string key = host + " " + port;
+	auto i = m_entries.find(key);
+	entry * e;
+	if (i == m_entries.end()){
+		e = new entry();
+		e->host = host;
+		e->port = port;
+		e->query = NULL;
+		e->expiry = 0;
+		e->failed = false;
+		m_entries[key] = e;
+		start(e);
+	}
+	else {
+		e = i->second;
+		if (e->query != NULL && gai_error(e->query) != EAI_INPROGRESS){
+			complete(e);
+		}
+		else if (e->query == NULL && monotonicNow() >= e->expiry){
+			/* expired, the previous addresses aren't used while the host is resolved again */
+			start(e);
+		}
+	}
+	return e;
+}
+
+void resolver::start(entry * e){
+	memset(&e->hints, 0, sizeof(e->hints));
+	e->hints.ai_family = AF_UNSPEC;
+	e->hints.ai_socktype = SOCK_STREAM;
+	e->addresses.clear();
+	e->failed = false;
+	/* numeric addresses don't need a query */
+	struct addrinfo hints = e->hints;
+	hints.ai_flags = AI_NUMERICHOST;
+	struct addrinfo * res;
+	if (getaddrinfo(e->host.c_str(), e->port.c_str(), &hints, &res) == 0){
+		e->query = new struct gaicb();
+		e->query->ar_result = res;
+		complete(e);
+		e->expiry = UINT64_MAX;
+		return;
+	}
+	e->query = new struct gaicb();
+	e->query->ar_name = e->host.c_str();
+	e->query->ar_service = e->port.c_str();
+	e->query->ar_request = &e->hints;
+	e->query->ar_result = NULL;
+	struct gaicb * list[1] = {e->query};
+	struct sigevent event;
+	memset(&event, 0, sizeof(event));
+	event.sigev_notify = SIGEV_THREAD;
+	event.sigev_notify_function = notify;
+	event.sigev_value.sival_ptr = this;
+	if (getaddrinfo_a(GAI_NOWAIT, list, 1, &event) != 0){
+		delete e->query;
+		e->query = NULL;
+		e->failed = true;
+		e->expiry = monotonicNow() + (uint64_t)RESOLVER_NEGATIVE_TTL * 1000000;
+	}
+}
+
+void resolver::complete(entry * e){
+	struct addrinfo * res = e->query->ar_result;
+	e->failed = res == NULL;
+	/* alternates the families : if the preferred one is broken, the second attempt already uses the other one */
+	vector<resolvedAddress> families[2];
+	int32_t first = -1;
+	for (struct addrinfo * i = res; i != NULL; i = i->ai_next){
+		if (i->ai_addrlen > sizeof(struct sockaddr_storage)){
+			continue;
+		}
+		if (first == -1){
+			first = i->ai_family;
+		}
+		resolvedAddress address;
+		memset(&address, 0, sizeof(address));
+		memcpy(&address.address, i->ai_addr, i->ai_addrlen);
+		address.length = i->ai_addrlen;
+		families[i->ai_family == first ? 0 : 1].push_back(address);
+	}
+	for (size_t i = 0; e->addresses.size() < RESOLVER_MAX_ADDRESSES && (i < families[0].size() || i < families[1].size()); i++){
+		for (size_t j = 0; j < 2; j++){
+			if (i < families[j].size() && e->addresses.size() < RESOLVER_MAX_ADDRESSES){
+				e->addresses.push_back(families[j][i]);
+			}
+		}
+	}
+	if (res != NULL){
+		freeaddrinfo(res);
+	}
+	delete e->query;
+	e->query = NULL;
+	e->expiry = monotonicNow() + (e->failed ? (uint64_t)RESOLVER_NEGATIVE_TTL * 1000000 : m_ttl);
+}
+
+bool resolver::cancel(entry * e){
+	if (e->query == NULL){
+		return true;
+	}
+	/* a query which can't be cancelled still uses the entry, it is leaked */
+	if (gai_cancel(e->query) == EAI_NOTCANCELED){
+		return false;
+	}
+	if (e->query->ar_result != NULL){
+		freeaddrinfo(e->query->ar_result);
+	}
+	delete e->query;
+	e->query = NULL;
+	return true;
+}
@@ -0,0 +1,102 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "clock.hpp"
+
+#define RESOLVER_DEFAULT_TTL 60
+/* seconds a resolved address is kept, getaddrinfo doesn't give the ttl of the dns records
+ */
+#define RESOLVER_NEGATIVE_TTL 5
+/* seconds a failed resolution is kept before the next attempt
+ */
+#define RESOLVER_MAX_ADDRESSES 8
+#define RESOLVER_DONE 0
+#define RESOLVER_PENDING 1
+#define RESOLVER_FAILED 2
+
+struct resolvedAddress
+{
+	struct sockaddr_storage address;
+	socklen_t length;
+};
+
+/* this class resolves host names without blocking (getaddrinfo_a, link with -lanl before glibc 2.34) and caches the results
+ * every client of the process shares one resolver (see shared) guarded by a mutex, so resolving the same host many times costs one query
+ * even when the clients are created and connected on different threads
+ * the addresses of a host are ordered for happy eyeballs : families alternate, starting with the one preferred by getaddrinfo
+ */
+class resolver
+{
+public:
+	static resolver& shared();
+	/* returns the resolver of the process, it is never destroyed so the queries still running when a thread or the process exits stay valid
+	 */
+	void setTtl(uint32_t ttl);
+	/* ttl : seconds a resolved address is kept before being resolved again (RESOLVER_DEFAULT_TTL by default)
+	 */
+	void request(const std::string& host, const std::string& port);
+	/* starts the resolution of host unless it is cached or already in progress, never blocks
+	 * numeric addresses are resolved immediately and never expire
+	 */
+	int32_t lookup(const std::string& host, const std::string& port, std::vector<resolvedAddress>& addresses);
+	/* same as request, stores the addresses of host in addresses once they are known
+	 * returns RESOLVER_DONE, RESOLVER_PENDING or RESOLVER_FAILED
+	 */
+	int32_t wait(const std::string& host, const std::string& port, int32_t timeout, std::vector<resolvedAddress>& addresses);
+	/* same as lookup but waits at most timeout ms for the resolution
+	 */
+	void invalidate(const std::string& host, const std::string& port);
+	/* forgets host, the next lookup resolves it again (e.g. after failing to connect to every address)
+	 */
+private:
+	resolver();
+	static void notify(union sigval value);
+	/* called by glibc when a query completes, wakes up the threads waiting in wait
+	 */
+	struct entry
+	{
+		std::string host;
+		std::string port;
+		struct addrinfo hints;
+		struct gaicb * query;
+		/* resolution in progress, NULL once completed
+		 */
+		std::vector<resolvedAddress> addresses;
+		uint64_t expiry;
+		/* monotonicNow() timestamp
+		 */
+		bool failed;
+	};
+	int32_t status(entry * e, std::vector<resolvedAddress>& addresses);
+	entry * find(const std::string& host, const std::string& port);
+	void start(entry * e);
+	void complete(entry * e);
+	bool cancel(entry * e);
+	/* returns false if the query is still running, the entry can't be freed then
+	 */
+	std::map<std::string, entry *> m_entries;
+	uint64_t m_ttl;
+	/* in microseconds
+	 */
+	std::mutex m_mutex;
+	/* held by every public method, the private ones are called with it
+	 */
+	std::condition_variable m_resolved;
+};
+
+#endif /* RESOLVER_HPP */
@@ -0,0 +1,134 @@
+#include "rpc_client.hpp"
+
+using namespace std;
+
+rpcClient::rpcClient(client * c) : m_client(c), m_nextDeadline(0){
+
+}
+
+rpcClient::~rpcClient(){
+	/* the client may already be destroyed, only the callbacks are called */
+	map<uint32_t, request> pending;
+	pending.swap(m_pending);
+	for (auto i = pending.begin(); i != pending.end(); i++){
+		if (i->second.callback != NULL){
+			i->second.callback(i->first, RPC_CANCELLED, NULL, 0, i->second.data);
+		}
+	}
+}
+
+uint32_t rpcClient::call(const char * request, size_t size, void callback(uint32_t, int32_t, const char *, size_t, void *), void * data, uint32_t timeout){
+	uint32_t id = 0;
+	try {
+		if (!m_client->isMultiplexed()){
+			throw clientError("rpc requires a connected and multiplexed client", ERROR_CLIENT_UNCONNECTED);
+		}
+		if (m_pending.size() >= RPC_MAX_PENDING){
+			throw clientError("too many pending requests", ERROR_CLIENT_WRITE);
+		}
+		id = m_client->openStream();
+		rpcClient::request r;
+		r.callback = callback;
+		r.data = data;
+		r.deadline = timeout != 0 ? monotonicNow() + (uint64_t)timeout * 1000 : 0;
+		/* registered before writing, the response can't be read before poll anyway */
+		m_pending[id] = r;
+		if (r.deadline != 0 && (m_nextDeadline == 0 || r.deadline < m_nextDeadline)){
+			m_nextDeadline = r.deadline;
+		}
+		if (!m_client->writeToStream(id, request, size)){
+			m_pending.erase(id);
+			m_client->closeStream(id);
+			throw clientError("can't send request " + to_string(id), ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const clientError& error){
+		error.outputMessage();
+		return 0;
+	}
+	return id;
+}
+
+bool rpcClient::cancel(uint32_t id){
+	if (m_pending.find(id) == m_pending.end()){
+		return false;
+	}
+	complete(id, RPC_CANCELLED, NULL, 0);
+	return true;
+}
+
+bool rpcClient::poll(){
+	char buffer[MAX_BUFFER_SIZE];
+	uint32_t stream;
+	size_t size = 0;
+	bool first = true;
+	/* the first read may wait on a blocking client, the next ones only return messages already received */
+	while (first || m_client->bufferedStreamMessages() > 0){
+		first = false;
+		if (!m_client->readFromStreams(&stream, buffer, &size)){
+			failAll(RPC_DISCONNECTED);
+			return false;
+		}
+		if (size == 0){
+			break;
+		}
+		if (m_pending.find(stream) != m_pending.end()){
+			complete(stream, RPC_OK, buffer, size);
+		}
+		else {
+			/* late response to a request which has expired or been cancelled */
+			m_client->closeStream(stream);
+		}
+	}
+	if (m_nextDeadline != 0){
+		uint64_t now = monotonicNow();
+		if (now >= m_nextDeadline){
+			expire(now);
+		}
+	}
+	return true;
+}
+
+size_t rpcClient::pending() const{
+	return m_pending.size();
+}
+
+void rpcClient::complete(uint32_t id, int32_t status, const char * response, size_t size){
+	auto i = m_pending.find(id);
+	rpcClient::request r = i->second;
+	m_pending.erase(i);
+	/* frees the stream on both sides */
+	m_client->closeStream(id);
+	if (r.callback != NULL){
+		r.callback(id, status, response, size, r.data);
+	}
+}
+
+void rpcClient::expire(uint64_t now){
+	/* callbacks may call or cancel requests, the expired ones are collected first */
+	vector<uint32_t> expired;
+	m_nextDeadline = 0;
+	for (auto i = m_pending.begin(); i != m_pending.end(); i++){
+		if (i->second.deadline == 0){
+			continue;
+		}
+		if (i->second.deadline <= now){
+			expired.push_back(i->first);
+		}
+		else if (m_nextDeadline == 0 || i->second.deadline < m_nextDeadline){
+			m_nextDeadline = i->second.deadline;
+		}
+	}
+	for (size_t i = 0; i < expired.size(); i++){
+		if (m_pending.find(expired[i]) != m_pending.end()){
+			complete(expired[i], RPC_TIMEOUT, NULL, 0);
+		}
+	}
+}
+
+void rpcClient::failAll(int32_t status){
+	while (!m_pending.empty()){
+		complete(m_pending.begin()->first, status, NULL, 0);
+	}
+	m_nextDeadline = 0;
+}
@@ -0,0 +1,79 @@
+#ifndef RPC_CLIENT_HPP
+#define RPC_CLIENT_HPP
+
+#include <sys/types.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "error.hpp"
+#include "client.hpp"
+#include "clock.hpp"
+
+#define RPC_DEFAULT_TIMEOUT 5000
+#define RPC_MAX_PENDING 512
+/* requests waiting for a response, kept below MUX_MAX_STREAMS so the server never sees too many streams
+ */
+#define RPC_OK 0
+#define RPC_TIMEOUT 1
+#define RPC_DISCONNECTED 2
+#define RPC_CANCELLED 3
+
+/* this class sends requests without waiting for the previous responses over a multiplexed client
+ * each request is sent on a stream of its own whose id is the correlation id of the request,
+ * the server reads it with server::readFromStreams and answers on the same stream, so responses can come back in any order
+ * requests and responses are binary, their size is carried by the frames
+ * a request is completed once : when its response is received, when its deadline is reached, when it is cancelled or when the connection is lost
+ */
+class rpcClient
+{
+public:
+	rpcClient(client * c);
+	/* c : client connected with multiplexing enabled, it isn't owned by rpcClient
+	 * a non-blocking client is advised, poll then never waits
+	 */
+	~rpcClient();
+	/* calls the callbacks of the pending requests with RPC_CANCELLED (they must not use this rpcClient anymore)
+	 * the client isn't used, so it can be destroyed before or after the rpcClient, the streams of these requests stay open on it
+	 */
+	uint32_t call(const char * request, size_t size, void callback(uint32_t, int32_t, const char *, size_t, void *), void * data = NULL, uint32_t timeout = RPC_DEFAULT_TIMEOUT);
+	/* sends a request of size bytes (at most MUX_MAX_MESSAGE_SIZE) and returns immediately
+	 * callback is called by poll with the correlation id, the status (RPC_OK, RPC_TIMEOUT, RPC_DISCONNECTED or RPC_CANCELLED),
+	 * the response and its size (NULL and 0 unless the status is RPC_OK) and data
+	 * timeout : milliseconds before the request fails with RPC_TIMEOUT (0 for no deadline)
+	 * returns the correlation id of the request, 0 on failure (RPC_MAX_PENDING requests waiting or connection error)
+	 */
+	bool cancel(uint32_t id);
+	/* completes the request id with RPC_CANCELLED, its response will be ignored
+	 * returns false if the request isn't pending
+	 */
+	bool poll();
+	/* reads the responses received (with a blocking client, waits for at least one) and completes the requests they answer,
+	 * then fails the requests whose deadline is reached
+	 * returns false if the connection is lost, every pending request is then completed with RPC_DISCONNECTED
+	 */
+	size_t pending() const;
+	/* returns the number of requests waiting for a response
+	 */
+private:
+	struct request
+	{
+		void (*callback)(uint32_t, int32_t, const char *, size_t, void *);
+		void * data;
+		uint64_t deadline;
+		/* monotonicNow() timestamp, 0 for no deadline
+		 */
+	};
+	void complete(uint32_t id, int32_t status, const char * response, size_t size);
+	void expire(uint64_t now);
+	void failAll(int32_t status);
+	client * m_client;
+	std::map<uint32_t, request> m_pending;
+	uint64_t m_nextDeadline;
+	/* earliest deadline of the pending requests (0 if none), expire only scans them once it is reached
+	 */
+};
+
+#endif /* RPC_CLIENT_HPP */
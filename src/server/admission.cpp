@@ -0,0 +1,149 @@
+#include "admission.hpp"
+
+using namespace std;
+
+admissionControl::admissionControl(uint32_t maxConnectionsPerSource, uint32_t acceptRate, uint32_t acceptBurst, uint32_t maxLoopLag, bool resetOnReject) : m_maxConnectionsPerSource(maxConnectionsPerSource), m_acceptRate(acceptRate), m_acceptBurst(acceptBurst), m_maxLoopLag(maxLoopLag), m_resetOnReject(resetOnReject), m_busy(0), m_worked(false), m_loopLag(0), m_admitCounter(0){
+	if (m_acceptBurst == 0){
+		m_acceptBurst = m_acceptRate;
+	}
+}
+
+admissionControl::~admissionControl(){
+
+}
+
+uint64_t admissionControl::now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void admissionControl::busy(uint64_t duration){
+	m_busy += duration;
+	m_worked = true;
+}
+
+void admissionControl::loopTick(){
+	if (!m_worked){
+		return;
+	}
+	uint64_t sample = m_busy < UINT32_MAX ? m_busy : UINT32_MAX;
+	/* exponential moving average over about 8 iterations */
+	m_loopLag = (uint32_t)(((uint64_t)m_loopLag * 7 + sample) / 8);
+	m_busy = 0;
+	m_worked = false;
+}
+
+bool admissionControl::overloaded() const{
+	return m_maxLoopLag != 0 && m_loopLag > m_maxLoopLag;
+}
+
+bool admissionControl::admit(const sockaddr * address, uint64_t timestamp){
+	if (++m_admitCounter % ADMISSION_SWEEP_INTERVAL == 0){
+		sweep(timestamp);
+	}
+	string key = sourceKey(address);
+	if (key.empty()){
+		return true;
+	}
+	auto i = m_sources.find(key);
+	if (i == m_sources.end()){
+		source s;
+		s.connections = 0;
+		s.tokens = m_acceptBurst;
+		s.lastRefill = timestamp;
+		i = m_sources.insert(make_pair(key, s)).first;
+	}
+	source& s = i->second;
+	if (m_maxConnectionsPerSource != 0 && s.connections >= m_maxConnectionsPerSource){
+		return false;
+	}
+	if (m_acceptRate != 0){
+		refill(s, timestamp);
+		if (s.tokens < 1){
+			return false;
+		}
+		s.tokens -= 1;
+	}
+	s.connections++;
+	return true;
+}
+
+void admissionControl::adopt(const sockaddr * address){
+	string key = sourceKey(address);
+	if (key.empty()){
+		return;
+	}
+	auto i = m_sources.find(key);
+	if (i == m_sources.end()){
+		source s;
+		s.connections = 0;
+		s.tokens = m_acceptBurst;
+		s.lastRefill = now();
+		i = m_sources.insert(make_pair(key, s)).first;
+	}
+	i->second.connections++;
+}
+
+void admissionControl::release(const sockaddr * address){
+	auto i = m_sources.find(sourceKey(address));
+	if (i != m_sources.end() && i->second.connections > 0){
+		i->second.connections--;
+	}
+}
+
+bool admissionControl::resetOnReject() const{
+	return m_resetOnReject;
+}
+
+uint32_t admissionControl::loopLag() const{
+	return m_loopLag;
+}
+
+size_t admissionControl::memoryUsage() const{
+	/* each map node holds the key, the source state and about four pointers of bookkeeping */
+	size_t total = sizeof(admissionControl);
+	for (auto i = m_sources.begin(); i != m_sources.end(); i++){
+		total += sizeof(*i) + 4 * sizeof(void *) + i->first.capacity();
+	}
+	return total;
+}
+
+string admissionControl::sourceKey(const sockaddr * address){
+	if (address->sa_family == AF_INET){
+		const struct sockaddr_in * in = (const struct sockaddr_in *)address;
+		return string((const char *)&in->sin_addr, sizeof(in->sin_addr));
+	}
+	else if (address->sa_family == AF_INET6){
+		const struct sockaddr_in6 * in6 = (const struct sockaddr_in6 *)address;
+		if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)){
+			return string((const char *)&in6->sin6_addr + 12, 4);
+		}
+		return string((const char *)&in6->sin6_addr, sizeof(in6->sin6_addr));
+	}
+	/* unix domain sockets have no meaningful source address */
+	return "";
+}
+
+void admissionControl::refill(source& s, uint64_t timestamp) const{
+	if (timestamp > s.lastRefill){
+		s.tokens += (double)(timestamp - s.lastRefill) * m_acceptRate / 1000000;
+		if (s.tokens > m_acceptBurst){
+			s.tokens = m_acceptBurst;
+		}
+	}
+	s.lastRefill = timestamp;
+}
+
+void admissionControl::sweep(uint64_t timestamp){
+	for (auto i = m_sources.begin(); i != m_sources.end();){
+		if (i->second.connections == 0){
+			refill(i->second, timestamp);
+			if (m_acceptRate == 0 || i->second.tokens >= m_acceptBurst){
+				i = m_sources.erase(i);
+				continue;
+			}
+		}
+		i++;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+
+#define ADMISSION_SWEEP_INTERVAL 1024
+
+/* this class decides if a new connection is admitted by the server
+ * it limits the number of connections and the accept rate per source address (token bucket refilled lazily)
+ * and refuses every connection while the event loop is lagging
+ */
+class admissionControl
+{
+public:
+	admissionControl(uint32_t maxConnectionsPerSource, uint32_t acceptRate, uint32_t acceptBurst, uint32_t maxLoopLag, bool resetOnReject);
+	/* see server::setAdmissionControl
+	 */
+	~admissionControl();
+	static uint64_t now();
+	/* returns a monotonic timestamp in microseconds
+	 */
+	void busy(uint64_t duration);
+	/* adds duration microseconds of work (reads, writes, handshakes, flushes) to the current event loop iteration
+	 */
+	void loopTick();
+	/* called once per event loop iteration, the work added since the previous call updates the smoothed loop lag
+	 * idle time (sleeps between iterations, waits in accept) isn't work, a quiet period doesn't look like a lag
+	 */
+	bool overloaded() const;
+	/* returns true if the loop lag is above the configured maximum
+	 */
+	bool admit(const sockaddr * address, uint64_t timestamp);
+	/* returns true if a connection from address can be accepted, it is then counted until released
+	 */
+	void adopt(const sockaddr * address);
+	/* counts a connection accepted by another server (moved by a loadBalancer) like an admitted one, it is never refused
+	 */
+	void release(const sockaddr * address);
+	/* must be called when an admitted connection is kicked
+	 */
+	bool resetOnReject() const;
+	uint32_t loopLag() const;
+	/* returns the smoothed loop lag in microseconds : the work of one iteration, which is how late an event can be handled
+	 */
+	size_t memoryUsage() const;
+	/* returns an estimation of the memory used to track source addresses
+	 */
+private:
+	struct source
+	{
+		uint32_t connections;
+		double tokens;
+		uint64_t lastRefill;
+	};
+	static std::string sourceKey(const sockaddr * address);
+	void refill(source& s, uint64_t timestamp) const;
+	void sweep(uint64_t timestamp);
+	uint32_t m_maxConnectionsPerSource;
+	uint32_t m_acceptRate;
+	uint32_t m_acceptBurst;
+	uint32_t m_maxLoopLag;
+	bool m_resetOnReject;
+	uint64_t m_busy;
+	/* work of the current iteration
+	 */
+	bool m_worked;
+	/* busy has been called since the last tick, consecutive calls to acceptConnection only count once
+	 */
+	uint32_t m_loopLag;
+	uint32_t m_admitCounter;
+	std::map<std::string, source> m_sources;
+};
+
+#endif /* ADMISSION_HPP */
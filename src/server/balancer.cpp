@@ -0,0 +1,112 @@
+#include "balancer.hpp"
+#include "connection.hpp"
+#include "admission.hpp"
+
+using namespace std;
+
+connectionLoad::connectionLoad() : bytes(0), messages(0), callbackTime(0), cost(0){
+
+}
+
+loadBalancer::loadBalancer(uint32_t workers, double imbalance) : m_imbalance(imbalance){
+	for (uint32_t i = 0; i < workers; i++){
+		worker * w = new worker();
+		w->load = 0;
+		w->reported = admissionControl::now();
+		w->posted = 0;
+		m_workers.push_back(w);
+	}
+}
+
+loadBalancer::~loadBalancer(){
+	clear();
+	for (size_t i = 0; i < m_workers.size(); i++){
+		delete m_workers[i];
+	}
+}
+
+uint32_t loadBalancer::workers() const{
+	return m_workers.size();
+}
+
+void loadBalancer::report(uint32_t worker, uint64_t cost, uint32_t connections){
+	m_workers[worker]->load = cost + (uint64_t)connections * LOAD_CONNECTION_COST;
+	m_workers[worker]->reported = admissionControl::now();
+}
+
+uint64_t loadBalancer::load(uint32_t worker) const{
+	return m_workers[worker]->load;
+}
+
+uint32_t loadBalancer::leastLoaded() const{
+	uint64_t now = admissionControl::now();
+	uint32_t least = 0;
+	uint64_t leastLoad = UINT64_MAX;
+	bool fresh = false;
+	for (size_t i = 0; i < m_workers.size(); i++){
+		/* a stuck worker would keep every connection waiting, a fresh load always wins over a stale one */
+		bool isFresh = !stale(i, now);
+		if (fresh && !isFresh){
+			continue;
+		}
+		/* connections waiting in the inbox are about to add load to the worker */
+		uint64_t load = m_workers[i]->load + (uint64_t)m_workers[i]->posted * LOAD_CONNECTION_COST;
+		if (load < leastLoad || (isFresh && !fresh)){
+			least = i;
+			leastLoad = load;
+			fresh = isFresh;
+		}
+	}
+	return least;
+}
+
+int32_t loadBalancer::migrationTarget(uint32_t worker, uint64_t * difference) const{
+	uint64_t now = admissionControl::now();
+	uint64_t load = m_workers[worker]->load;
+	uint32_t least = leastLoaded();
+	uint64_t leastLoad = m_workers[least]->load;
+	for (size_t i = 0; i < m_workers.size(); i++){
+		if (m_workers[i]->load > load && !stale(i, now)){
+			return -1;
+		}
+	}
+	if (least == worker || stale(least, now) || load <= leastLoad || load - leastLoad < LOAD_MIN_IMBALANCE || load <= leastLoad * m_imbalance){
+		return -1;
+	}
+	if (difference != NULL){
+		*difference = load - leastLoad;
+	}
+	return least;
+}
+
+void loadBalancer::post(uint32_t worker, connection * c){
+	lock_guard<mutex> guard(m_workers[worker]->lock);
+	m_workers[worker]->inbox.push_back(c);
+	m_workers[worker]->posted++;
+}
+
+bool loadBalancer::collect(uint32_t worker, vector<connection *>& connections){
+	if (m_workers[worker]->posted == 0){
+		return false;
+	}
+	lock_guard<mutex> guard(m_workers[worker]->lock);
+	connections.insert(connections.end(), m_workers[worker]->inbox.begin(), m_workers[worker]->inbox.end());
+	m_workers[worker]->inbox.clear();
+	m_workers[worker]->posted = 0;
+	return true;
+}
+
+bool loadBalancer::stale(uint32_t worker, uint64_t now) const{
+	uint64_t reported = m_workers[worker]->reported;
+	return now > reported && now - reported > LOAD_STALE_TIMEOUT;
+}
+
+void loadBalancer::clear(){
+	for (size_t i = 0; i < m_workers.size(); i++){
+		vector<connection *> connections;
+		collect(i, connections);
+		for (size_t j = 0; j < connections.size(); j++){
+			delete connections[j];
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef BALANCER_HPP
+#define BALANCER_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#define LOAD_WINDOW 1000000
+/* microseconds between two load measures
+ */
+#define LOAD_MESSAGE_COST 2
+/* microseconds of work counted for each message besides the time spent in the callback (reading, parsing, system calls)
+ */
+#define LOAD_BYTE_COST 1024
+/* bytes counted as one microsecond of work
+ */
+#define LOAD_CONNECTION_COST 10
+/* microseconds per second counted for each connection, so idle workers get the new connections in turn
+ */
+#define LOAD_MIN_IMBALANCE 20000
+/* microseconds per second (2% of a core) under which workers are considered balanced
+ */
+#define LOAD_STALE_TIMEOUT 5000000
+/* microseconds after which the load of a worker which stopped reporting it (stuck or not calling balanceConnections) is ignored
+ */
+
+class connection;
+
+/* load of one connection, allocated when the server is balanced
+ * counters are reset every LOAD_WINDOW, cost is the smoothed work per second in microseconds
+ */
+class connectionLoad
+{
+public:
+	connectionLoad();
+	uint64_t bytes;
+	uint32_t messages;
+	uint64_t callbackTime;
+	uint64_t cost;
+};
+
+/* this class spreads connections between servers run by different threads (one server per thread, see server::setLoadBalancer)
+ * workers publish their load, new connections are accepted by the least loaded one
+ * and the most loaded worker moves connections to the least loaded one when their loads differ by more than imbalance
+ * it is the only object of the library which can be used by several threads at once
+ */
+class loadBalancer
+{
+public:
+	loadBalancer(uint32_t workers, double imbalance = 1.5);
+	/* workers : number of servers balanced
+	 * imbalance : connections are moved when the load of the most loaded worker is more than imbalance times the load of the least loaded one
+	 */
+	~loadBalancer();
+	uint32_t workers() const;
+	void report(uint32_t worker, uint64_t cost, uint32_t connections);
+	/* publishes the load of worker : cost is its work per second in microseconds
+	 * a load which isn't published again within LOAD_STALE_TIMEOUT is stale
+	 */
+	uint64_t load(uint32_t worker) const;
+	/* returns the last load published by worker (cost plus LOAD_CONNECTION_COST per connection)
+	 */
+	uint32_t leastLoaded() const;
+	/* returns the worker which should get the next connection, workers whose load is stale are skipped unless every load is stale
+	 */
+	int32_t migrationTarget(uint32_t worker, uint64_t * difference = NULL) const;
+	/* returns the worker to which worker should move load, -1 if worker isn't the most loaded or if the workers are balanced
+	 * workers whose load is stale are ignored and never get connections
+	 * if difference is not NULL and a worker is returned, the difference between the two loads compared is written in it
+	 * (the loads can be published again meanwhile, reading them a second time could give another difference)
+	 */
+	void post(uint32_t worker, connection * c);
+	/* gives c to worker, which takes it with collect
+	 */
+	bool collect(uint32_t worker, std::vector<connection *>& connections);
+	/* moves the connections given to worker in connections
+	 * returns false if there was none
+	 */
+	void clear();
+	/* deletes the connections posted and not collected yet
+	 */
+private:
+	struct worker
+	{
+		std::atomic<uint64_t> load;
+		std::atomic<uint64_t> reported;
+		/* admissionControl::now() timestamp of the last report
+		 */
+		std::atomic<uint32_t> posted;
+		/* number of connections in inbox, checked without locking
+		 */
+		std::mutex lock;
+		std::vector<connection *> inbox;
+	};
+	bool stale(uint32_t worker, uint64_t now) const;
+	std::vector<worker *> m_workers;
+	double m_imbalance;
+};
+
+#endif /* BALANCER_HPP */
@@ -0,0 +1,301 @@
+#include "basic_server.hpp"
+
+using namespace std;
+
+template <class Transport, class IoMode>
+basic_connection<Transport, IoMode>::basic_connection() : m_socket(-1), m_inactivityCounter(0), m_connectionCounter(0), m_id(-1){
+
+}
+
+template <class Transport, class IoMode>
+basic_connection<Transport, IoMode>::~basic_connection(){
+	disconnect();
+}
+
+template <class Transport, class IoMode>
+int32_t basic_connection<Transport, IoMode>::getSocket() const{
+	return m_socket;
+}
+
+template <class Transport, class IoMode>
+bool basic_connection<Transport, IoMode>::accept(int32_t mainSocket, SSL_CTX * sslContext){
+	try {
+		int32_t ret = ::accept(mainSocket, NULL, NULL);
+		if (ret == -1 && errno != EWOULDBLOCK){
+			throw serverError("can't accept connection", ERROR_CLIENT_ACCEPT);
+		}
+		else if (ret == -1){
+			return false;
+		}
+		m_socket = ret;
+		if (!IoMode::setup(m_socket)){
+			throw serverError("can't set non blocking mode", ERROR_CLIENT_ACCEPT);
+		}
+		if (!m_transport.attach(m_socket, sslContext, true)){
+			throw serverError("can't create SSL", ERROR_CLIENT_ACCEPT);
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+template <class Transport, class IoMode>
+bool basic_connection<Transport, IoMode>::doHandshake(){
+	try {
+		ssize_t ret = m_transport.handshake();
+		if (ret == TRANSPORT_ERROR || ret == TRANSPORT_CLOSED){
+			throw serverError("handshake can't be made", ERROR_CLIENT_HANDSHAKE);
+		}
+		return ret == 1;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+template <class Transport, class IoMode>
+bool basic_connection<Transport, IoMode>::ishandshakeMade() const{
+	return m_transport.handshakeMade();
+}
+
+template <class Transport, class IoMode>
+void basic_connection<Transport, IoMode>::disconnect(){
+	m_transport.release();
+	if (m_socket != -1){
+		shutdown(m_socket, SHUT_RDWR);
+		close(m_socket);
+		m_socket = -1;
+	}
+	m_inactivityCounter = 0;
+	m_connectionCounter = 0;
+	m_id = -1;
+}
+
+template <class Transport, class IoMode>
+uint32_t basic_connection<Transport, IoMode>::inactivityCounter() const{
+	return m_inactivityCounter;
+}
+
+template <class Transport, class IoMode>
+uint32_t basic_connection<Transport, IoMode>::connectionCounter() const{
+	return m_connectionCounter;
+}
+
+template <class Transport, class IoMode>
+bool basic_connection<Transport, IoMode>::readFromConnection(char buffer[MAX_BUFFER_SIZE], size_t * size){
+	try {
+		m_inactivityCounter++;
+		m_connectionCounter++;
+		*size = 0;
+		if (m_socket == -1 || !m_transport.handshakeMade()){
+			return true;
+		}
+		ssize_t ret = m_transport.read(m_socket, buffer, MAX_BUFFER_SIZE);
+		if (ret > 0){
+			m_inactivityCounter = 0;
+			*size = ret;
+		}
+		else if (ret == TRANSPORT_CLOSED){
+			/* kicked by the next cleanupConnections */
+			disconnect();
+		}
+		else if (ret == TRANSPORT_ERROR){
+			throw serverError("error while reading from connection", ERROR_CLIENT_READ);
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+template <class Transport, class IoMode>
+bool basic_connection<Transport, IoMode>::writeToConnection(const char * buffer, size_t size){
+	try {
+		if (m_socket == -1 || !m_transport.handshakeMade()){
+			return true;
+		}
+		size_t sent = 0;
+		while (sent < size){
+			ssize_t ret = m_transport.write(m_socket, buffer + sent, size - sent);
+			if (ret > 0){
+				sent += ret;
+			}
+			else if (ret == TRANSPORT_ERROR || ret == TRANSPORT_CLOSED){
+				throw serverError("error while writing to connection", ERROR_CLIENT_WRITE);
+			}
+			else if (!IoMode::blocking){
+				/* without outbound queue, waiting would stall every connection and dropping the bytes would desync the client */
+				throw serverError("the socket of the connection is full", ERROR_CLIENT_WRITE);
+			}
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+template <class Transport, class IoMode>
+void basic_connection<Transport, IoMode>::identifyConnection(int64_t id){
+	m_id = id;
+}
+
+template <class Transport, class IoMode>
+int64_t basic_connection<Transport, IoMode>::getConnectionId() const{
+	return m_id;
+}
+
+template <class Transport, class IoMode>
+size_t basic_connection<Transport, IoMode>::memoryUsage() const{
+	return sizeof(basic_connection) + (Transport::tls ? TLS_STATE_MEMORY_ESTIMATE + TLS_BUFFERS_MEMORY_ESTIMATE : 0);
+}
+
+specializedServer::~specializedServer(){
+
+}
+
+specializedServer * specializedServer::create(bool tlsMode, bool blocking, uint32_t maxConnections, uint32_t maxInactivityCounter, uint32_t maxConnectionCounter){
+	if (tlsMode && blocking){
+		return new basic_server<tlsTransport, blockingIo>(maxConnections, maxInactivityCounter, maxConnectionCounter);
+	}
+	if (tlsMode){
+		return new basic_server<tlsTransport, nonBlockingIo>(maxConnections, maxInactivityCounter, maxConnectionCounter);
+	}
+	if (blocking){
+		return new basic_server<plainTransport, blockingIo>(maxConnections, maxInactivityCounter, maxConnectionCounter);
+	}
+	return new basic_server<plainTransport, nonBlockingIo>(maxConnections, maxInactivityCounter, maxConnectionCounter);
+}
+
+template <class Transport, class IoMode>
+basic_server<Transport, IoMode>::basic_server(uint32_t maxConnections, uint32_t maxInactivityCounter, uint32_t maxConnectionCounter) : m_maxConnections(maxConnections), m_connectedConnections(0), m_maxInactivityCounter(maxInactivityCounter), m_maxConnectionCounter(maxConnectionCounter){
+
+}
+
+template <class Transport, class IoMode>
+basic_server<Transport, IoMode>::~basic_server(){
+	kickConnections();
+}
+
+template <class Transport, class IoMode>
+bool basic_server<Transport, IoMode>::acceptConnection(int32_t mainSocket, SSL_CTX * sslContext){
+	if (m_maxConnections <= m_connectedConnections){
+		int32_t socket = ::accept(mainSocket, NULL, NULL);
+		if (socket != -1){
+			close(socket);
+		}
+		return false;
+	}
+	m_connections.emplace_back();
+	if (!m_connections.back().accept(mainSocket, sslContext)){
+		m_connections.pop_back();
+		return false;
+	}
+	m_connectedConnections++;
+	return true;
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::handshakeConnections(){
+	if (!Transport::tls){
+		return;
+	}
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		if (!i->ishandshakeMade()){
+			i->doHandshake();
+		}
+	}
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::cleanupConnections(){
+	for (auto i = m_connections.begin(); i != m_connections.end();){
+		if ((i->inactivityCounter() >= m_maxInactivityCounter && m_maxInactivityCounter != 0) || i->getSocket() == -1 || (i->connectionCounter() >= m_maxConnectionCounter && m_maxConnectionCounter != 0)){
+			i = m_connections.erase(i);
+			m_connectedConnections--;
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::readFromConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data){
+	readFromConnections([callback, data](int64_t id, char buffer[MAX_BUFFER_SIZE], size_t * size, bool * response){
+		int64_t tmp = callback(id, buffer, data, response);
+		*size = strnlen(buffer, MAX_BUFFER_SIZE);
+		return tmp;
+	});
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::readFromStreams(int64_t callback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data){
+	readFromConnections([callback, data](int64_t id, char buffer[MAX_BUFFER_SIZE], size_t * size, bool * response){
+		return callback(id, 0, buffer, size, data, response);
+	});
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data){
+	writeToConnections([callback, data](int64_t id, char buffer[MAX_BUFFER_SIZE]){
+		return callback(id, buffer, data);
+	});
+}
+
+template <class Transport, class IoMode>
+uint32_t basic_server<Transport, IoMode>::drainConnections(uint32_t count){
+	for (uint32_t i = 0; i < count && !m_connections.empty(); i++){
+		m_connections.pop_front();
+		m_connectedConnections--;
+	}
+	return m_connectedConnections;
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::kickConnections(){
+	m_connections.clear();
+	m_connectedConnections = 0;
+}
+
+template <class Transport, class IoMode>
+uint32_t basic_server<Transport, IoMode>::connectedConnections() const{
+	return m_connectedConnections;
+}
+
+template <class Transport, class IoMode>
+size_t basic_server<Transport, IoMode>::memoryUsage() const{
+	/* list nodes hold two pointers of bookkeeping besides their value */
+	size_t total = sizeof(basic_server);
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		total += i->memoryUsage() + 2 * sizeof(void *);
+	}
+	return total;
+}
+
+template <class Transport, class IoMode>
+void basic_server<Transport, IoMode>::memoryUsagePerConnection(void callback(int64_t, size_t, void *), void * data) const{
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		callback(i->getConnectionId(), i->memoryUsage(), data);
+	}
+}
+
+template class basic_connection<plainTransport, blockingIo>;
+template class basic_connection<plainTransport, nonBlockingIo>;
+template class basic_connection<tlsTransport, blockingIo>;
+template class basic_connection<tlsTransport, nonBlockingIo>;
+template class basic_server<plainTransport, blockingIo>;
+template class basic_server<plainTransport, nonBlockingIo>;
+template class basic_server<tlsTransport, blockingIo>;
+template class basic_server<tlsTransport, nonBlockingIo>;
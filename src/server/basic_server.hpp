@@ -0,0 +1,185 @@
+#ifndef BASIC_SERVER_HPP
+#define BASIC_SERVER_HPP
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+#include <list>
+
+#include "connection.hpp"
+#include "transport.hpp"
+
+/* compile-time specialized connection, Transport is plainTransport or tlsTransport and IoMode is blockingIo or nonBlockingIo (see transport.hpp)
+ * it holds no tls or blocking flags and a plain connection holds no tls state
+ */
+template <class Transport, class IoMode>
+class basic_connection
+{
+public:
+	basic_connection();
+	~basic_connection();
+	basic_connection(const basic_connection&) = delete;
+	basic_connection& operator=(const basic_connection&) = delete;
+	int32_t getSocket() const;
+	bool accept(int32_t mainSocket, SSL_CTX * sslContext);
+	/* same as connection::accept, sslContext is ignored by plainTransport
+	 */
+	bool doHandshake();
+	bool ishandshakeMade() const;
+	void disconnect();
+	uint32_t inactivityCounter() const;
+	uint32_t connectionCounter() const;
+	bool readFromConnection(char buffer[MAX_BUFFER_SIZE], size_t * size);
+	/* same as connection::readFromConnection, without compression and multiplexing
+	 */
+	bool writeToConnection(const char * buffer, size_t size);
+	/* writes the size bytes of buffer, there is no outbound queue :
+	 * in blocking mode it waits until they are sent, in non-blocking mode it fails if the socket doesn't take them all
+	 * returns true on success, false otherwise (the connection is then disconnected)
+	 */
+	void identifyConnection(int64_t id);
+	int64_t getConnectionId() const;
+	size_t memoryUsage() const;
+	/* returns the number of bytes used by the connection (tls memory is estimated)
+	 */
+private:
+	int32_t m_socket;
+	uint32_t m_inactivityCounter;
+	uint32_t m_connectionCounter;
+	int64_t m_id;
+	Transport m_transport;
+};
+
+/* calls of the server class forwarded to the basic_server matching its tls and blocking modes (see server::setLeanMode)
+ * the listening socket and the tls context stay in the server, they are given to acceptConnection
+ */
+class specializedServer
+{
+public:
+	virtual ~specializedServer();
+	static specializedServer * create(bool tlsMode, bool blocking, uint32_t maxConnections, uint32_t maxInactivityCounter, uint32_t maxConnectionCounter);
+	/* returns the basic_server specialized for tlsMode and blocking
+	 */
+	virtual bool acceptConnection(int32_t mainSocket, SSL_CTX * sslContext) = 0;
+	virtual void handshakeConnections() = 0;
+	virtual void cleanupConnections() = 0;
+	virtual void readFromConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data) = 0;
+	virtual void readFromStreams(int64_t callback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data) = 0;
+	virtual void writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data) = 0;
+	virtual uint32_t drainConnections(uint32_t count) = 0;
+	virtual void kickConnections() = 0;
+	virtual uint32_t connectedConnections() const = 0;
+	virtual size_t memoryUsage() const = 0;
+	virtual void memoryUsagePerConnection(void callback(int64_t, size_t, void *), void * data) const = 0;
+};
+
+/* compile-time specialized core of the server class : the tls and blocking branches are resolved at compile time,
+ * connections are stored by value and the callbacks given to the template functions can be any callable object, so they can be inlined
+ * it only handles connections (accept, handshake, read, write, cleanup), the server class owns the listening socket and the other features
+ */
+template <class Transport, class IoMode>
+class basic_server final : public specializedServer
+{
+public:
+	basic_server(uint32_t maxConnections, uint32_t maxInactivityCounter = 0, uint32_t maxConnectionCounter = 0);
+	/* same parameters as the server class, the tls and blocking modes are given by the template parameters
+	 */
+	~basic_server();
+	bool acceptConnection(int32_t mainSocket, SSL_CTX * sslContext) override;
+	/* accepts one connection waiting on mainSocket, created with the tls context sslContext (ignored by plainTransport)
+	 * a full server accepts and closes the connection
+	 * returns true if a connection has been added, false otherwise
+	 */
+	void handshakeConnections() override;
+	void cleanupConnections() override;
+	template <class Callback>
+	void readFromConnections(Callback callback);
+	/* reads every connection and calls callback(id, buffer, &size, &response) with the size of the message received,
+	 * if it sets response to true the size first bytes of buffer are sent back, it returns the new id as for server::readFromConnections
+	 */
+	void readFromConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data) override;
+	void readFromStreams(int64_t callback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data) override;
+	/* connections aren't multiplexed, the stream is always 0
+	 */
+	template <class Callback>
+	void writeToConnections(Callback callback);
+	/* calls callback(id, buffer) for every connection, the message in buffer is sent if it returns true
+	 */
+	void writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data) override;
+	uint32_t drainConnections(uint32_t count) override;
+	/* kicks at most count connections, returns the number of connections left
+	 */
+	void kickConnections() override;
+	uint32_t connectedConnections() const override;
+	size_t memoryUsage() const override;
+	void memoryUsagePerConnection(void callback(int64_t, size_t, void *), void * data) const override;
+private:
+	typedef std::list<basic_connection<Transport, IoMode> > connectionList;
+	connectionList m_connections;
+	uint32_t m_maxConnections;
+	uint32_t m_connectedConnections;
+	uint32_t m_maxInactivityCounter;
+	uint32_t m_maxConnectionCounter;
+};
+
+template <class Transport, class IoMode>
+template <class Callback>
+void basic_server<Transport, IoMode>::readFromConnections(Callback callback){
+	char buffer[MAX_BUFFER_SIZE];
+	for (auto i = m_connections.begin(); i != m_connections.end();){
+		memset(buffer, 0, sizeof(buffer));
+		size_t size = 0;
+		if (!i->readFromConnection(buffer, &size)){
+			i = m_connections.erase(i);
+			m_connectedConnections--;
+			continue;
+		}
+		bool response = false;
+		int64_t tmp = callback(i->getConnectionId(), buffer, &size, &response);
+		if (tmp > 0){
+			i->identifyConnection(tmp);
+		}
+		/* a response which can't be written leaves the connection unusable */
+		if (tmp == -1 || (response && size > 0 && !i->writeToConnection(buffer, size < MAX_BUFFER_SIZE ? size : MAX_BUFFER_SIZE))){
+			i = m_connections.erase(i);
+			m_connectedConnections--;
+			continue;
+		}
+		i++;
+	}
+}
+
+template <class Transport, class IoMode>
+template <class Callback>
+void basic_server<Transport, IoMode>::writeToConnections(Callback callback){
+	char buffer[MAX_BUFFER_SIZE];
+	for (auto i = m_connections.begin(); i != m_connections.end();){
+		memset(buffer, 0, sizeof(buffer));
+		if (callback(i->getConnectionId(), buffer) && !i->writeToConnection(buffer, strnlen(buffer, MAX_BUFFER_SIZE))){
+			i = m_connections.erase(i);
+			m_connectedConnections--;
+			continue;
+		}
+		i++;
+	}
+}
+
+/* instantiated once in the library (basic_server.cpp) */
+extern template class basic_connection<plainTransport, blockingIo>;
+extern template class basic_connection<plainTransport, nonBlockingIo>;
+extern template class basic_connection<tlsTransport, blockingIo>;
+extern template class basic_connection<tlsTransport, nonBlockingIo>;
+extern template class basic_server<plainTransport, blockingIo>;
+extern template class basic_server<plainTransport, nonBlockingIo>;
+extern template class basic_server<tlsTransport, blockingIo>;
+extern template class basic_server<tlsTransport, nonBlockingIo>;
+
+typedef basic_server<plainTransport, blockingIo> plainBlockingServer;
+typedef basic_server<plainTransport, nonBlockingIo> plainServer;
+typedef basic_server<tlsTransport, blockingIo> tlsBlockingServer;
+typedef basic_server<tlsTransport, nonBlockingIo> tlsServer;
+
+#endif /* BASIC_SERVER_HPP */
@@ -0,0 +1,105 @@
+#include "capture.hpp"
+
+using namespace std;
+
+captureLog::captureLog() : m_fd(-1), m_map(NULL), m_size(0), m_header(NULL){
+
+}
+
+captureLog::~captureLog(){
+	close();
+}
+
+bool captureLog::open(const string& path, uint64_t capacity, uint64_t start){
+	close();
+	if ((m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1){
+		return false;
+	}
+	m_size = sizeof(captureHeader) + capacity;
+	/* the file is sparse, pages are only allocated once records reach them */
+	if (ftruncate(m_fd, m_size) != 0){
+		close();
+		return false;
+	}
+	void * map = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED){
+		close();
+		return false;
+	}
+	m_map = (char *)map;
+	m_header = (captureHeader *)m_map;
+	memcpy(m_header->magic, CAPTURE_MAGIC, sizeof(m_header->magic));
+	m_header->version = CAPTURE_VERSION;
+	m_header->start = start;
+	m_header->used = 0;
+	m_header->dropped = 0;
+	return true;
+}
+
+void captureLog::close(){
+	uint64_t length = 0;
+	if (m_map != NULL){
+		length = sizeof(captureHeader) + m_header->used;
+		munmap(m_map, m_size);
+		m_map = NULL;
+		m_header = NULL;
+	}
+	if (m_fd != -1){
+		if (length != 0){
+			ftruncate(m_fd, length);
+		}
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_size = 0;
+}
+
+bool captureLog::append(uint64_t timestamp, uint64_t connection, uint32_t stream, uint16_t type, const char * message, uint32_t size){
+	if (m_map == NULL){
+		return false;
+	}
+	bool stored = message != NULL || size == 0;
+	uint64_t length = (sizeof(captureRecord) + (stored ? size : 0) + CAPTURE_ALIGNMENT - 1) & ~(uint64_t)(CAPTURE_ALIGNMENT - 1);
+	if (sizeof(captureHeader) + m_header->used + length > m_size){
+		m_header->dropped++;
+		return false;
+	}
+	captureRecord * record = (captureRecord *)(m_map + sizeof(captureHeader) + m_header->used);
+	record->timestamp = timestamp > m_header->start ? timestamp - m_header->start : 0;
+	record->connection = connection;
+	record->stream = stream;
+	record->type = type;
+	record->flags = stored ? 0 : CAPTURE_FLAG_UNSTORED;
+	record->size = size;
+	record->reserved2 = 0;
+	if (stored && size > 0){
+		memcpy((char *)record + sizeof(captureRecord), message, size);
+	}
+	/* written last so a reader of the file never sees a partial record */
+	__atomic_store_n(&m_header->used, m_header->used + length, __ATOMIC_RELEASE);
+	return true;
+}
+
+uint64_t captureLog::used() const{
+	return m_header != NULL ? m_header->used : 0;
+}
+
+uint64_t captureLog::dropped() const{
+	return m_header != NULL ? m_header->dropped : 0;
+}
+
+bool captureLog::next(const char * data, uint64_t used, uint64_t * position, const captureRecord ** record, const char ** message){
+	if (*position + sizeof(captureRecord) > used){
+		return false;
+	}
+	const captureRecord * r = (const captureRecord *)(data + *position);
+	bool stored = !(r->flags & CAPTURE_FLAG_UNSTORED);
+	uint64_t length = (sizeof(captureRecord) + (stored ? r->size : 0) + CAPTURE_ALIGNMENT - 1) & ~(uint64_t)(CAPTURE_ALIGNMENT - 1);
+	if (*position + length > used){
+		return false;
+	}
+	*record = r;
+	*message = stored ? data + *position + sizeof(captureRecord) : NULL;
+	*position += length;
+	return true;
+}
@@ -0,0 +1,105 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <string>
+#include <cstdint>
+
+#define CAPTURE_MAGIC "TLCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_ACCEPT 0
+#define CAPTURE_READ 1
+#define CAPTURE_WRITE 2
+#define CAPTURE_KICK 3
+#define CAPTURE_FLAG_UNSTORED 1
+/* the size bytes of the record aren't stored in the capture (file transfers)
+ */
+#define CAPTURE_ALIGNMENT 8
+/* records start on multiples of CAPTURE_ALIGNMENT bytes
+ */
+
+/* header of a capture file, followed by the records in the order they were written
+ */
+struct captureHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t start;
+	/* monotonic time (see admissionControl::now) when the capture started
+	 */
+	uint64_t used;
+	/* bytes of records written after the header, stored with release semantics after the record so a reader loading it with acquire semantics sees whole records
+	 */
+	uint64_t dropped;
+	/* records which didn't fit in the file
+	 */
+};
+
+/* one event of a captured connection, followed by size bytes of message (padded to CAPTURE_ALIGNMENT) unless CAPTURE_FLAG_UNSTORED is set
+ */
+struct captureRecord
+{
+	uint64_t timestamp;
+	/* microseconds since the start of the capture
+	 */
+	uint64_t connection;
+	/* number of the connection in the capture (ids and sockets are reused, this number isn't)
+	 */
+	uint32_t stream;
+	/* stream of the message for multiplexed connections, 0 otherwise
+	 */
+	uint16_t type;
+	/* CAPTURE_ACCEPT, CAPTURE_READ (message given to the callback), CAPTURE_WRITE (message sent) or CAPTURE_KICK
+	 */
+	uint16_t flags;
+	uint32_t size;
+	uint32_t reserved2;
+};
+
+/* this class appends records to a file mapped in memory, a record costs a memcpy and no system call
+ * the file has a fixed capacity, records which don't fit are dropped and counted
+ */
+class captureLog
+{
+public:
+	captureLog();
+	~captureLog();
+	bool open(const std::string& path, uint64_t capacity, uint64_t start);
+	/* creates the file path able to hold capacity bytes of records and maps it
+	 * start : timestamp the record timestamps are relative to
+	 * returns true on success, false otherwise
+	 */
+	void close();
+	/* unmaps the file and truncates it to the records written
+	 */
+	bool append(uint64_t timestamp, uint64_t connection, uint32_t stream, uint16_t type, const char * message, uint32_t size);
+	/* writes a record (timestamp is absolute), returns false if it doesn't fit
+	 * message NULL with a size records size bytes sent without storing them (CAPTURE_FLAG_UNSTORED)
+	 */
+	uint64_t used() const;
+	/* returns the number of bytes of records written
+	 */
+	uint64_t dropped() const;
+	/* returns the number of records dropped
+	 */
+	static bool next(const char * data, uint64_t used, uint64_t * position, const captureRecord ** record, const char ** message);
+	/* reads the record at position in the used bytes of records data of a capture file and moves position to the next one
+	 * message is NULL for a record whose bytes aren't stored
+	 * returns false at the end of the records or if the record is truncated
+	 */
+private:
+	int32_t m_fd;
+	char * m_map;
+	uint64_t m_size;
+	/* size of the mapping, header included
+	 */
+	captureHeader * m_header;
+};
+
+#endif /* CAPTURE_HPP */
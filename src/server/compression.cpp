@@ -0,0 +1,245 @@
+#include "compression.hpp"
+
+using namespace std;
+
+compressionPool::compressionPool(int32_t level, uint32_t threshold) : m_level(level), m_threshold(threshold), m_dictionaryId(1){
+#ifdef TLS_USE_ZSTD
+	m_compressionDictionary = NULL;
+	m_decompressionDictionary = NULL;
+#endif
+}
+
+compressionPool::~compressionPool(){
+#ifdef TLS_USE_ZSTD
+	for (auto i = m_compressors.begin(); i != m_compressors.end(); i++){
+		ZSTD_freeCCtx(*i);
+	}
+	for (auto i = m_decompressors.begin(); i != m_decompressors.end(); i++){
+		ZSTD_freeDCtx(*i);
+	}
+	ZSTD_freeCDict(m_compressionDictionary);
+	ZSTD_freeDDict(m_decompressionDictionary);
+#endif
+}
+
+bool compressionPool::loadDictionary(const string& pathToDictionary){
+	if (pathToDictionary.empty()){
+		return true;
+	}
+	FILE * file = fopen(pathToDictionary.c_str(), "rb");
+	if (file == NULL){
+		return false;
+	}
+	string dictionary;
+	char chunk[4096];
+	size_t ret;
+	while ((ret = fread(chunk, 1, sizeof(chunk), file)) > 0){
+		dictionary.append(chunk, ret);
+	}
+	fclose(file);
+	if (dictionary.empty()){
+		return false;
+	}
+	/* raw content dictionaries have no id, a FNV-1a hash of the content is used instead */
+	uint32_t id = 2166136261u;
+	for (size_t i = 0; i < dictionary.size(); i++){
+		id = (id ^ (uint8_t)dictionary[i]) * 16777619u;
+	}
+#ifdef TLS_USE_ZSTD
+	if (ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size()) != 0){
+		id = ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+	}
+	ZSTD_freeCDict(m_compressionDictionary);
+	ZSTD_freeDDict(m_decompressionDictionary);
+	m_compressionDictionary = ZSTD_createCDict(dictionary.data(), dictionary.size(), m_level);
+	m_decompressionDictionary = ZSTD_createDDict(dictionary.data(), dictionary.size());
+	if (m_compressionDictionary == NULL || m_decompressionDictionary == NULL){
+		return false;
+	}
+#endif
+	m_dictionaryId = (id <= 1) ? id + 2 : id;
+	return true;
+}
+
+bool compressionPool::available(){
+#ifdef TLS_USE_ZSTD
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t compressionPool::dictionaryId() const{
+	return m_dictionaryId;
+}
+
+ssize_t compressionPool::encode(const char * message, size_t size, char * frame, size_t frameCapacity){
+	if (frameCapacity < size + COMPRESSION_HEADER_SIZE || size > UINT16_MAX){
+		return -1;
+	}
+#ifdef TLS_USE_ZSTD
+	if (size >= m_threshold){
+		ZSTD_CCtx * context = acquireCompressor();
+		if (context != NULL){
+			size_t ret;
+			/* the compressed payload must be smaller than the message, otherwise it is sent raw */
+			if (m_compressionDictionary != NULL){
+				ret = ZSTD_compress_usingCDict(context, frame + COMPRESSION_HEADER_SIZE, size, message, size, m_compressionDictionary);
+			}
+			else {
+				ret = ZSTD_compressCCtx(context, frame + COMPRESSION_HEADER_SIZE, size, message, size, m_level);
+			}
+			releaseCompressor(context);
+			if (!ZSTD_isError(ret) && ret < size){
+				writeHeader(frame, COMPRESSION_FRAME_ZSTD, ret);
+				return ret + COMPRESSION_HEADER_SIZE;
+			}
+		}
+	}
+#endif
+	writeHeader(frame, COMPRESSION_FRAME_RAW, size);
+	memcpy(frame + COMPRESSION_HEADER_SIZE, message, size);
+	return size + COMPRESSION_HEADER_SIZE;
+}
+
+ssize_t compressionPool::decode(const char * frame, size_t frameSize, char * message, size_t messageCapacity){
+	if (compressionPool::frameSize(frame, frameSize) != (ssize_t)frameSize){
+		return -1;
+	}
+	size_t payloadSize = frameSize - COMPRESSION_HEADER_SIZE;
+	if (frame[0] == COMPRESSION_FRAME_RAW){
+		if (payloadSize > messageCapacity){
+			return -1;
+		}
+		memmove(message, frame + COMPRESSION_HEADER_SIZE, payloadSize);
+		return payloadSize;
+	}
+#ifdef TLS_USE_ZSTD
+	if (frame[0] == COMPRESSION_FRAME_ZSTD){
+		ZSTD_DCtx * context = acquireDecompressor();
+		if (context == NULL){
+			return -1;
+		}
+		size_t ret;
+		if (m_decompressionDictionary != NULL){
+			ret = ZSTD_decompress_usingDDict(context, message, messageCapacity, frame + COMPRESSION_HEADER_SIZE, payloadSize, m_decompressionDictionary);
+		}
+		else {
+			ret = ZSTD_decompressDCtx(context, message, messageCapacity, frame + COMPRESSION_HEADER_SIZE, payloadSize);
+		}
+		releaseDecompressor(context);
+		if (ZSTD_isError(ret)){
+			return -1;
+		}
+		/* zstd may use the end of message as a workspace, it is cleared as messages are handled as strings */
+		memset(message + ret, 0, messageCapacity - ret);
+		return ret;
+	}
+#endif
+	return -1;
+}
+
+ssize_t compressionPool::frameSize(const char * data, size_t size){
+	if (size < COMPRESSION_HEADER_SIZE){
+		return 0;
+	}
+	if (data[0] != COMPRESSION_FRAME_RAW && data[0] != COMPRESSION_FRAME_ZSTD){
+		return -1;
+	}
+	uint16_t length;
+	memcpy(&length, data + 1, sizeof(length));
+	if (size < COMPRESSION_HEADER_SIZE + (size_t)ntohs(length)){
+		return 0;
+	}
+	return COMPRESSION_HEADER_SIZE + ntohs(length);
+}
+
+void compressionPool::writeHeader(char * frame, uint8_t type, uint16_t length){
+	frame[0] = type;
+	length = htons(length);
+	memcpy(frame + 1, &length, sizeof(length));
+}
+
+void compressionPool::makeHello(char hello[COMPRESSION_HELLO_SIZE], uint32_t dictionaryId){
+	uint32_t id = htonl(dictionaryId);
+	memcpy(hello, COMPRESSION_HELLO_MAGIC, 4);
+	memcpy(hello + 4, &id, 4);
+}
+
+bool compressionPool::isHello(const char * message, size_t size, uint32_t * dictionaryId){
+	if (size != COMPRESSION_HELLO_SIZE || memcmp(message, COMPRESSION_HELLO_MAGIC, 4) != 0){
+		return false;
+	}
+	uint32_t id;
+	memcpy(&id, message + 4, 4);
+	if (dictionaryId != NULL){
+		*dictionaryId = ntohl(id);
+	}
+	return true;
+}
+
+size_t compressionPool::pooledContexts() const{
+#ifdef TLS_USE_ZSTD
+	return m_compressors.size() + m_decompressors.size();
+#else
+	return 0;
+#endif
+}
+
+size_t compressionPool::memoryUsage() const{
+	size_t total = sizeof(compressionPool);
+#ifdef TLS_USE_ZSTD
+	total += ZSTD_sizeof_CDict(m_compressionDictionary) + ZSTD_sizeof_DDict(m_decompressionDictionary);
+	for (auto i = m_compressors.begin(); i != m_compressors.end(); i++){
+		total += ZSTD_sizeof_CCtx(*i);
+	}
+	for (auto i = m_decompressors.begin(); i != m_decompressors.end(); i++){
+		total += ZSTD_sizeof_DCtx(*i);
+	}
+#endif
+	return total;
+}
+
+#ifdef TLS_USE_ZSTD
+ZSTD_CCtx * compressionPool::acquireCompressor(){
+	if (m_compressors.empty()){
+		ZSTD_CCtx * context = ZSTD_createCCtx();
+		if (context != NULL){
+			ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, m_level);
+			ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 0);
+			ZSTD_CCtx_setParameter(context, ZSTD_c_contentSizeFlag, 1);
+		}
+		return context;
+	}
+	ZSTD_CCtx * context = m_compressors.back();
+	m_compressors.pop_back();
+	return context;
+}
+
+void compressionPool::releaseCompressor(ZSTD_CCtx * context){
+	if (m_compressors.size() < COMPRESSION_MAX_POOLED_CONTEXTS){
+		m_compressors.push_back(context);
+	}
+	else {
+		ZSTD_freeCCtx(context);
+	}
+}
+
+ZSTD_DCtx * compressionPool::acquireDecompressor(){
+	if (m_decompressors.empty()){
+		return ZSTD_createDCtx();
+	}
+	ZSTD_DCtx * context = m_decompressors.back();
+	m_decompressors.pop_back();
+	return context;
+}
+
+void compressionPool::releaseDecompressor(ZSTD_DCtx * context){
+	if (m_decompressors.size() < COMPRESSION_MAX_POOLED_CONTEXTS){
+		m_decompressors.push_back(context);
+	}
+	else {
+		ZSTD_freeDCtx(context);
+	}
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+#ifdef TLS_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#define COMPRESSION_HEADER_SIZE 3
+/* frame header : type (1 byte), payload length (2 bytes, network order)
+ */
+#define COMPRESSION_FRAME_RAW 0
+#define COMPRESSION_FRAME_ZSTD 1
+#define COMPRESSION_HELLO_SIZE 8
+#define COMPRESSION_MAX_POOLED_CONTEXTS 16
+
+/* negotiation : once connected the client sends COMPRESSION_HELLO_MAGIC followed by the dictionary id (network order)
+ * the server answers with the same message if it uses the same dictionary, or with a dictionary id of 0 to refuse
+ * once accepted, every message is sent in a frame whose header tells if the payload is raw or compressed and gives its length,
+ * so frames can be split or merged by the transport
+ */
+#define COMPRESSION_HELLO_MAGIC "\0TLZ"
+
+/* this class holds the shared dictionary and a pool of zstd contexts used to compress messages, it is shared by the server and client classes
+ * contexts are only taken from the pool for the duration of one message so idle connections don't keep any compressor state
+ * compression is only available when the library is built with TLS_USE_ZSTD defined (and linked with libzstd)
+ */
+class compressionPool
+{
+public:
+	compressionPool(int32_t level, uint32_t threshold);
+	/* level : zstd compression level
+	 * threshold : messages smaller than threshold bytes are sent raw
+	 */
+	~compressionPool();
+	bool loadDictionary(const std::string& pathToDictionary);
+	/* loads the shared dictionary (zstd dictionary or raw content), an empty path means no dictionary
+	 * returns true on success, false otherwise
+	 */
+	static bool available();
+	/* returns true if the library has been built with zstd support
+	 */
+	uint32_t dictionaryId() const;
+	/* returns the id sent during negotiation, both sides must use the same dictionary
+	 */
+	ssize_t encode(const char * message, size_t size, char * frame, size_t frameCapacity);
+	/* writes message in frame (header included), compressed if it is worth it
+	 * returns the size of the frame on success, -1 otherwise
+	 */
+	ssize_t decode(const char * frame, size_t frameSize, char * message, size_t messageCapacity);
+	/* writes the message contained in frame in message
+	 * returns the size of the message on success, -1 otherwise
+	 */
+	static ssize_t frameSize(const char * data, size_t size);
+	/* returns the size of the frame starting at data if its size bytes contain all of it,
+	 * 0 if more bytes are needed and -1 if the header is invalid
+	 */
+	static void makeHello(char hello[COMPRESSION_HELLO_SIZE], uint32_t dictionaryId);
+	static bool isHello(const char * message, size_t size, uint32_t * dictionaryId);
+	/* returns true if message is a negotiation message, the dictionary id it contains is stored in dictionaryId
+	 */
+	size_t pooledContexts() const;
+	/* returns the number of contexts currently kept in the pool
+	 */
+	size_t memoryUsage() const;
+	/* returns the memory used by the dictionaries and the pooled contexts
+	 */
+private:
+	static void writeHeader(char * frame, uint8_t type, uint16_t length);
+	int32_t m_level;
+	uint32_t m_threshold;
+	uint32_t m_dictionaryId;
+#ifdef TLS_USE_ZSTD
+	ZSTD_CCtx * acquireCompressor();
+	void releaseCompressor(ZSTD_CCtx * context);
+	ZSTD_DCtx * acquireDecompressor();
+	void releaseDecompressor(ZSTD_DCtx * context);
+	ZSTD_CDict * m_compressionDictionary;
+	ZSTD_DDict * m_decompressionDictionary;
+	std::vector<ZSTD_CCtx*> m_compressors;
+	std::vector<ZSTD_DCtx*> m_decompressors;
+#endif
+};
+
+#endif /* COMPRESSION_HPP */
@@ -2,12 +2,18 @@
 
 using namespace std;
 
-connection::connection(bool tlsMode, bool blocking) : m_tlsMode(tlsMode), m_blocking(blocking), m_handshakeMade(false), m_socket(-1), m_ssl(NULL), m_inactivityCounter(0), m_connectionCounter(0), m_id(-1){
+connection::connection(bool tlsMode, bool blocking, bool lowMemory) : m_ssl(NULL), m_outbound(NULL), m_input(NULL), m_compressionPool(NULL), m_rateState(NULL), m_load(NULL), m_mux(NULL), m_id(-1), m_socket(-1), m_inactivityCounter(0), m_connectionCounter(0), m_tlsMode(tlsMode), m_blocking(blocking), m_lowMemory(lowMemory), m_handshakeMade(false), m_compressed(false), m_multiplexingOffered(false){
 	memset(&m_connectionAddress, 0, sizeof(m_connectionAddress));
 }
 
 connection::~connection(){
 	disconnect();
+	if (m_rateState != NULL){
+		delete m_rateState;
+	}
+	if (m_load != NULL){
+		delete m_load;
+	}
 }
 
 int32_t connection::getSocket() const{
@@ -17,7 +23,7 @@ int32_t connection::getSocket() const{
 bool connection::accept(int32_t mainSocket, SSL_CTX * sslContext){
 	try {
 		socklen_t addressLen = sizeof(m_connectionAddress);
-		int32_t ret = ::accept(mainSocket, (struct sockaddr *)&m_connectionAddress, &addressLen);
+		int32_t ret = ::accept(mainSocket, &m_connectionAddress.address, &addressLen);
 		if (ret == -1 && errno != EWOULDBLOCK){
 			throw serverError("can't accept connection", ERROR_CLIENT_ACCEPT);
 		}
@@ -58,15 +64,18 @@ bool connection::accept(int32_t mainSocket, SSL_CTX * sslContext){
 bool connection::doHandshake(){
 	try {
 		if (m_tlsMode && !m_handshakeMade){
+			TLS_TRACE1(handshake_start, m_socket);
 			int ret = SSL_accept(m_ssl);
 			if (ret != 1){
 				int tmp = SSL_get_error(m_ssl, ret);
 				if (tmp != SSL_ERROR_WANT_READ && tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_CONNECT && tmp != SSL_ERROR_WANT_ACCEPT){
+					TLS_TRACE2(handshake_end, m_socket, 0);
 					throw serverError("handshake can't be made (ssl_get_error returns : " + to_string(tmp) + ")", ERROR_CLIENT_HANDSHAKE);
 					return false;
 				}
 			}
 			else {
+				TLS_TRACE2(handshake_end, m_socket, 1);
 				m_handshakeMade = true;
 				return true;
 			}
@@ -95,10 +104,25 @@ uint32_t connection::inactivityCounter() const{
 	return m_inactivityCounter;
 }
 
-void connection::disconnect(){
-	memset(&m_connectionAddress, 0, sizeof(m_connectionAddress));
+uint32_t connection::connectionCounter() const{
+	return m_connectionCounter;
+}
+
+void connection::disconnect(bool reset){
+	if (m_outbound != NULL){
+		delete m_outbound;
+		m_outbound = NULL;
+	}
 	if (m_socket != -1){
-		shutdown(m_socket, SHUT_RDWR);
+		if (reset){
+			struct linger l;
+			l.l_onoff = 1;
+			l.l_linger = 0;
+			setsockopt(m_socket, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+		}
+		else {
+			shutdown(m_socket, SHUT_RDWR);
+		}
 		close(m_socket);
 		m_socket = -1;
 	}
@@ -107,19 +131,40 @@ void connection::disconnect(){
 		SSL_free(m_ssl);
 		m_ssl = NULL;
 	}
+	if (m_mux != NULL){
+		delete m_mux;
+		m_mux = NULL;
+	}
+	if (m_input != NULL){
+		delete m_input;
+		m_input = NULL;
+	}
 	m_handshakeMade = false;
+	m_compressed = false;
 	m_inactivityCounter = 0;
 	m_connectionCounter = 0;
 	m_id = -1;
 }
 
-bool connection::readFromConnection(char buffer[MAX_BUFFER_SIZE]){
+bool connection::readFromConnection(char buffer[MAX_BUFFER_SIZE], size_t * size){
 	try {
 		m_inactivityCounter++;
 		m_connectionCounter++;
-		if (m_tlsMode && m_handshakeMade){
+		char frame[MAX_BUFFER_SIZE + COMPRESSION_HEADER_SIZE];
+		char * target = m_compressed ? frame : buffer;
+		size_t targetSize = m_compressed ? sizeof(frame) : MAX_BUFFER_SIZE;
+		ssize_t received = 0;
+		if (size != NULL){
+			*size = 0;
+		}
+		/* a frame completed by a previous read is returned before reading more */
+		bool buffered = m_input != NULL && compressionPool::frameSize(m_input->data(), m_input->size()) != 0;
+		if (buffered){
+			m_inactivityCounter = 0;
+		}
+		else if (m_tlsMode && m_handshakeMade){
 			int ret;
-			if ((ret = SSL_read(m_ssl, buffer, MAX_BUFFER_SIZE)) <= 0){
+			if ((ret = SSL_read(m_ssl, target, targetSize)) <= 0){
 				int tmp = SSL_get_error(m_ssl, ret);
 				if (tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_READ){
 					throw serverError("error while reading from connection (tls)", ERROR_CLIENT_READ);
@@ -127,22 +172,75 @@ bool connection::readFromConnection(char buffer[MAX_BUFFER_SIZE]){
 			}
 			else {
 				m_inactivityCounter = 0;
+				received = ret;
 			}
 		}
 		else if (!m_tlsMode){
 			int ret;
-			if ((ret = recv(m_socket, buffer, MAX_BUFFER_SIZE, 0)) < 0){
+			if ((ret = recv(m_socket, target, targetSize, 0)) < 0){
 				if (errno != EWOULDBLOCK){
 					throw serverError("error while reading from connection (non-tls)", ERROR_CLIENT_READ);
 				}
 			}
 			else if (ret != 0) {
 				m_inactivityCounter = 0;
+				received = ret;
 			}
 			else {
 				disconnect();
 			}
 		}
+		if (received > 0){
+			TLS_TRACE2(read, m_id, received);
+		}
+		if (m_compressed && (received > 0 || buffered)){
+			/* frames can be split between reads or share one, they are reassembled in m_input */
+			if (m_input == NULL){
+				m_input = new string();
+			}
+			m_input->append(frame, received);
+			ssize_t length = compressionPool::frameSize(m_input->data(), m_input->size());
+			if (length < 0){
+				throw serverError("invalid compressed frame", ERROR_CLIENT_READ);
+			}
+			received = 0;
+			if (length > 0){
+				memset(buffer, 0, MAX_BUFFER_SIZE);
+				if ((received = m_compressionPool->decode(m_input->data(), length, buffer, MAX_BUFFER_SIZE)) < 0){
+					throw serverError("can't decode compressed message", ERROR_CLIENT_READ);
+				}
+				m_input->erase(0, length);
+			}
+			if (m_input->empty()){
+				delete m_input;
+				m_input = NULL;
+			}
+		}
+		if (received > 0){
+			uint32_t dictionaryId;
+			if (!m_compressed && compressionPool::isHello(buffer, received, &dictionaryId)){
+				negotiateCompression(dictionaryId);
+				memset(buffer, 0, MAX_BUFFER_SIZE);
+				received = 0;
+			}
+			uint32_t version;
+			if (m_mux != NULL && received > 0){
+				/* frames are kept by the session until nextStreamMessage */
+				if (!m_mux->consume(buffer, received)){
+					throw serverError("invalid multiplexed frame", ERROR_CLIENT_READ);
+				}
+				memset(buffer, 0, MAX_BUFFER_SIZE);
+				received = 0;
+			}
+			else if (received > 0 && muxSession::isHello(buffer, received, &version)){
+				negotiateMultiplexing(version);
+				memset(buffer, 0, MAX_BUFFER_SIZE);
+				received = 0;
+			}
+			if (size != NULL){
+				*size = received;
+			}
+		}
 		return true;
 	}
 	catch (const serverError& error){
@@ -153,14 +251,37 @@ bool connection::readFromConnection(char buffer[MAX_BUFFER_SIZE]){
 }
 
 bool connection::writeToConnection(char buffer[MAX_BUFFER_SIZE]){
+	return writeToConnection(buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+}
+
+bool connection::writeToConnection(const char * buffer, size_t size){
 	try {
 		int max_buffer_size;
-		if (strlen(buffer) < MAX_BUFFER_SIZE){
-			max_buffer_size = strlen(buffer);
+		if (size < MAX_BUFFER_SIZE){
+			max_buffer_size = size;
 		}
 		else {
 			max_buffer_size = MAX_BUFFER_SIZE;
 		}
+		char frame[MAX_BUFFER_SIZE + COMPRESSION_HEADER_SIZE];
+		if (m_compressed){
+			ssize_t frameSize = m_compressionPool->encode(buffer, max_buffer_size, frame, sizeof(frame));
+			if (frameSize < 0){
+				throw serverError("can't encode message", ERROR_CLIENT_WRITE);
+			}
+			buffer = frame;
+			max_buffer_size = frameSize;
+		}
+		TLS_TRACE2(write, m_id, max_buffer_size);
+		/* a message written while a file or an older message is being sent waits behind it */
+		if (m_outbound != NULL && !flushMessages()){
+			return false;
+		}
+		if (hasPendingOutput()){
+			queueMessage(buffer, max_buffer_size);
+			return true;
+		}
+		/* bytes the socket doesn't take are queued, dropping them would desync the framing of the peer */
 		if (m_tlsMode && m_handshakeMade){
 			int ret;
 			if ((ret = SSL_write(m_ssl, buffer, max_buffer_size)) <= 0){
@@ -168,13 +289,20 @@ bool connection::writeToConnection(char buffer[MAX_BUFFER_SIZE]){
 				if (tmp != SSL_ERROR_WANT_WRITE && tmp != SSL_ERROR_WANT_READ){
 					throw serverError("error while writing to connection (tls)", ERROR_CLIENT_WRITE);
 				}
+				/* the outbound queue retries the write with the same bytes */
+				queueMessage(buffer, max_buffer_size);
 			}
 		}
 		else if (!m_tlsMode){
-			if (send(m_socket, buffer, max_buffer_size, 0) <= 0){
-				if (errno != EWOULDBLOCK){
+			ssize_t sent = send(m_socket, buffer, max_buffer_size, 0);
+			if (sent < 0){
+				if (errno != EWOULDBLOCK && errno != EAGAIN){
 					throw serverError("error while writing to connection (non-tls)", ERROR_CLIENT_WRITE);
 				}
+				sent = 0;
+			}
+			if (sent < max_buffer_size){
+				queueMessage(buffer + sent, max_buffer_size - sent);
 			}
 		}
 		return true;
@@ -186,6 +314,73 @@ bool connection::writeToConnection(char buffer[MAX_BUFFER_SIZE]){
 	return false;
 }
 
+void connection::offerCompression(compressionPool * pool){
+	m_compressionPool = pool;
+}
+
+bool connection::isCompressed() const{
+	return m_compressed;
+}
+
+void connection::negotiateCompression(uint32_t dictionaryId){
+	char hello[COMPRESSION_HELLO_SIZE];
+	bool accepted = m_compressionPool != NULL && compressionPool::available() && m_compressionPool->dictionaryId() == dictionaryId;
+	compressionPool::makeHello(hello, accepted ? dictionaryId : 0);
+	if (writeToConnection(hello, COMPRESSION_HELLO_SIZE)){
+		m_compressed = accepted;
+	}
+}
+
+void connection::offerMultiplexing(bool offered){
+	m_multiplexingOffered = offered;
+}
+
+bool connection::isMultiplexed() const{
+	return m_mux != NULL;
+}
+
+bool connection::nextStreamMessage(uint32_t * stream, char buffer[MAX_BUFFER_SIZE], size_t * size){
+	if (m_mux == NULL){
+		return false;
+	}
+	memset(buffer, 0, MAX_BUFFER_SIZE);
+	return m_mux->next(stream, buffer, size);
+}
+
+bool connection::writeToStream(uint32_t stream, const char * buffer, size_t size){
+	if (m_mux == NULL || !m_mux->queue(stream, buffer, size)){
+		return false;
+	}
+	return flushStreams();
+}
+
+bool connection::flushStreams(){
+	if (m_mux == NULL){
+		return true;
+	}
+	if (hasPendingOutput() && !flushMessages()){
+		return false;
+	}
+	char frames[MAX_BUFFER_SIZE];
+	size_t size;
+	/* frames stay in the streams while the socket is full, so the queue only holds what the socket refused */
+	while (!hasPendingOutput() && (size = m_mux->produce(frames, sizeof(frames))) > 0){
+		if (!writeToConnection(frames, size)){
+			return false;
+		}
+	}
+	return true;
+}
+
+void connection::negotiateMultiplexing(uint32_t version){
+	char hello[MUX_HELLO_SIZE];
+	bool accepted = m_multiplexingOffered && version == MUX_VERSION;
+	muxSession::makeHello(hello, accepted ? MUX_VERSION : 0);
+	if (writeToConnection(hello, MUX_HELLO_SIZE) && accepted){
+		m_mux = new muxSession(false);
+	}
+}
+
 void connection::identifyConnection(int64_t id){
 	m_id = id;
 }
@@ -193,3 +388,153 @@ void connection::identifyConnection(int64_t id){
 int64_t connection::getConnectionId() const{
 	return m_id;
 }
+
+const sockaddr * connection::getAddress() const{
+	return &m_connectionAddress.address;
+}
+
+size_t connection::memoryUsage() const{
+	size_t total = sizeof(connection);
+	if (m_outbound != NULL){
+		total += m_outbound->memoryUsage();
+	}
+	if (m_rateState != NULL){
+		total += sizeof(rateState);
+	}
+	if (m_load != NULL){
+		total += sizeof(connectionLoad);
+	}
+	if (m_mux != NULL){
+		total += sizeof(muxSession);
+	}
+	if (m_input != NULL){
+		total += sizeof(string) + m_input->capacity();
+	}
+	if (m_ssl != NULL){
+		total += TLS_STATE_MEMORY_ESTIMATE;
+		/* with SSL_MODE_RELEASE_BUFFERS OpenSSL frees its buffers when no data is pending */
+		if (!m_lowMemory || SSL_has_pending(m_ssl)){
+			total += TLS_BUFFERS_MEMORY_ESTIMATE;
+		}
+	}
+	return total;
+}
+
+bool connection::sendFile(int32_t fd, off_t offset, size_t len){
+	try {
+		if (m_socket == -1){
+			throw serverError("trying to send a file on a disconnected connection", ERROR_CLIENT_WRITE);
+		}
+		if (m_compressed){
+			/* the client decodes every byte as compressed frames */
+			throw serverError("files can't be sent on a compressed connection", ERROR_CLIENT_WRITE);
+		}
+		if (m_mux != NULL){
+			/* the client reads every byte as stream frames */
+			throw serverError("files can't be sent on a multiplexed connection", ERROR_CLIENT_WRITE);
+		}
+		if (m_outbound == NULL){
+			m_outbound = new outboundQueue();
+		}
+		if (!m_outbound->pushFile(fd, offset, len)){
+			throw serverError("can't queue file " + to_string(fd), ERROR_CLIENT_WRITE);
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+	return false;
+}
+
+bool connection::flush(void callback(int64_t, int32_t, void *), void * data){
+	try {
+		if (m_outbound == NULL || (m_tlsMode && !m_handshakeMade)){
+			return true;
+		}
+		while (!m_outbound->empty()){
+			int32_t completedFd = -1;
+			int32_t ret = m_outbound->progress(m_socket, m_tlsMode ? m_ssl : NULL, &completedFd);
+			if (ret == -1){
+				throw serverError("error while sending file to connection", ERROR_CLIENT_WRITE);
+			}
+			else if (ret == 1){
+				if (callback != NULL && completedFd != -1){
+					callback(m_id, completedFd, data);
+				}
+			}
+			else if (!m_blocking){
+				break;
+			}
+		}
+		if (m_outbound->empty()){
+			delete m_outbound;
+			m_outbound = NULL;
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+bool connection::flushMessages(){
+	try {
+		if (m_outbound == NULL || (m_tlsMode && !m_handshakeMade)){
+			return true;
+		}
+		while (m_outbound->frontIsMessage()){
+			int32_t ret = m_outbound->progress(m_socket, m_tlsMode ? m_ssl : NULL, NULL);
+			if (ret == -1){
+				throw serverError("error while writing to connection", ERROR_CLIENT_WRITE);
+			}
+			else if (ret == 0 && !m_blocking){
+				break;
+			}
+		}
+		if (m_outbound->empty()){
+			delete m_outbound;
+			m_outbound = NULL;
+		}
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		disconnect();
+	}
+	return false;
+}
+
+void connection::queueMessage(const char * buffer, size_t size){
+	if (m_outbound == NULL){
+		m_outbound = new outboundQueue();
+	}
+	m_outbound->pushMessage(buffer, size);
+}
+
+bool connection::hasPendingOutput() const{
+	return m_outbound != NULL && !m_outbound->empty();
+}
+
+size_t connection::pendingOutputBytes() const{
+	if (m_outbound == NULL){
+		return 0;
+	}
+	return m_outbound->pendingBytes();
+}
+
+rateState * connection::rates(bool create){
+	if (m_rateState == NULL && create){
+		m_rateState = new rateState();
+	}
+	return m_rateState;
+}
+
+connectionLoad * connection::load(){
+	if (m_load == NULL){
+		m_load = new connectionLoad();
+	}
+	return m_load;
+}
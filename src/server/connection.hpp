@@ -14,14 +14,36 @@
 #include <cstdint>
 
 #define MAX_BUFFER_SIZE 8192
+#define TLS_STATE_MEMORY_ESTIMATE 15360
+#define TLS_BUFFERS_MEMORY_ESTIMATE 33792
+/* memory held by OpenSSL for a server side tls 1.3 connection once the handshake is made :
+ * the SSL object and session (always) and its read and write buffers (released while idle in low memory mode)
+ */
 
 #include "error.hpp"
+#include "outbound.hpp"
+#include "compression.hpp"
+#include "ratelimit.hpp"
+#include "trace.hpp"
+#include "mux.hpp"
+#include "balancer.hpp"
+/* address of the peer, large enough for IPv4 and IPv6 addresses (unix domain peers are unnamed)
+ */
+union peerAddress
+{
+	sockaddr address;
+	sockaddr_in address4;
+	sockaddr_in6 address6;
+};
+
 /* this class is used by the server class and handles one connexion
  */
 class connection
 {
 public:
-	connection(bool tlsMode, bool blocking);
+	connection(bool tlsMode, bool blocking, bool lowMemory = false);
+	/* lowMemory : the SSL_CTX releases idle buffers (see server::setLowMemoryMode), used by memoryUsage
+	 */
 	~connection();
 	int32_t getSocket() const;
 	/* returns the socket fileno
@@ -34,8 +56,9 @@ public:
 	/* handshake negociation
 	 * returns true on success, false otherwise
 	 */
-	void disconnect();
+	void disconnect(bool reset = false);
 	/* disconnect connection
+	 * reset : the connection is aborted (RST) instead of being closed gracefully
 	 */
 	bool isTls() const;
 	bool isBlocking() const;
@@ -46,31 +69,117 @@ public:
 	uint32_t connectionCounter() const;
 	/* the connectionCounter increases by one each call to readFromConnection
 	 */
-	bool readFromConnection(char buffer[MAX_BUFFER_SIZE]);
+	bool readFromConnection(char buffer[MAX_BUFFER_SIZE], size_t * size = NULL);
 	/* tries to read from the connection, result is stored in buffer
+	 * if size is not NULL the number of bytes stored in buffer is written in it
+	 * compression negotiation messages are handled here and never stored in buffer
 	 * returns true on success, false otherwise
 	 */
 	bool writeToConnection(char buffer[MAX_BUFFER_SIZE]);
 	/* tries to write buffer to the connection
 	 * returns true on success, false otherwise
 	 */
+	bool writeToConnection(const char * buffer, size_t size);
+	/* tries to write size bytes of buffer to the connection (buffer may contain null bytes)
+	 * if some data is waiting in the outbound queue, the message is queued behind it
+	 * the bytes the socket doesn't take right away are queued too, they are sent by flushMessages or flush
+	 * returns true on success, false otherwise
+	 */
+	bool sendFile(int32_t fd, off_t offset, size_t len);
+	/* queues len bytes of the file fd starting at offset on the outbound queue (len 0 sends up to the end of the file)
+	 * the transfer is made by flush, fd must stay open until it is completed
+	 * the bytes of the file are sent as they are, so compressed and multiplexed connections refuse it
+	 * returns true on success, false otherwise
+	 */
+	bool flush(void callback(int64_t, int32_t, void *), void * data);
+	/* sends as much queued data as possible (without blocking in non-blocking mode)
+	 * callback (if not NULL) is called with the connection id, the file descriptor and data each time a file transfer is completed
+	 * returns true on success, false otherwise
+	 */
+	bool flushMessages();
+	/* same as flush but stops at the first queued file, the messages queued behind a file are sent by flush
+	 * returns true on success, false otherwise
+	 */
+	bool hasPendingOutput() const;
+	/* returns true if some data is waiting in the outbound queue (messages written while a file was being sent are queued too)
+	 */
+	size_t pendingOutputBytes() const;
+	/* returns the number of bytes waiting in the outbound queue
+	 */
+	rateState * rates(bool create = true);
+	/* returns the token buckets of the connection, allocated on the first call with create
+	 * (NULL until then : a connection without buckets has them full)
+	 */
+	connectionLoad * load();
+	/* returns the load counters of the connection (allocated on the first call)
+	 */
+	void offerCompression(compressionPool * pool);
+	/* pool (owned by the server) is used if the client asks for compression with the same dictionary
+	 */
+	bool isCompressed() const;
+	/* returns true if compression has been negotiated with the client
+	 */
 	void identifyConnection(int64_t id);
 	/* replace connection id (m_id) by id
 	 */
 	int64_t getConnectionId() const;
+	void offerMultiplexing(bool offered);
+	/* allows the client to negociate stream multiplexing (see muxSession)
+	 */
+	bool isMultiplexed() const;
+	bool nextStreamMessage(uint32_t * stream, char buffer[MAX_BUFFER_SIZE], size_t * size);
+	/* stores the next complete message received on a stream in buffer (multiplexed connections only)
+	 * returns false if no message is waiting
+	 */
+	bool writeToStream(uint32_t stream, const char * buffer, size_t size);
+	/* queues size bytes of buffer on stream and sends as many frames as the streams credit allows
+	 * returns true on success, false otherwise
+	 */
+	bool flushStreams();
+	/* sends the frames waiting to be sent (credit updates and queued messages)
+	 * frames are only produced once the outbound queue is empty, the next call sends the rest
+	 * returns true on success, false otherwise
+	 */
+	const sockaddr * getAddress() const;
+	/* returns the address of the peer (kept after disconnection)
+	 */
+	size_t memoryUsage() const;
+	/* returns the number of bytes held by the connection (tls memory is estimated)
+	 */
 private:
-	bool m_tlsMode;
-	bool m_blocking;
-	bool m_handshakeMade;
-	int32_t m_socket;
-	sockaddr_in m_connectionAddress;
+	void negotiateCompression(uint32_t dictionaryId);
+	void negotiateMultiplexing(uint32_t version);
+	void queueMessage(const char * buffer, size_t size);
 	SSL * m_ssl;
-	uint32_t m_inactivityCounter;
-	uint32_t m_connectionCounter;
+	outboundQueue * m_outbound;
+	/* allocated by sendFile or by a write the socket doesn't fully take, and freed once it is empty
+	 * messages written meanwhile are queued behind
+	 */
+	std::string * m_input;
+	/* bytes of compressed frames not complete yet or not returned yet, allocated while some are kept
+	 */
+	compressionPool * m_compressionPool;
+	rateState * m_rateState;
+	connectionLoad * m_load;
+	muxSession * m_mux;
+	/* allocated once multiplexing is negociated
+	 */
 	int64_t m_id;
 	/* connection id is used to differenciate connections
 	 * it is by default to -1
 	 */
+	int32_t m_socket;
+	uint32_t m_inactivityCounter;
+	uint32_t m_connectionCounter;
+	peerAddress m_connectionAddress;
+	bool m_tlsMode : 1;
+	bool m_blocking : 1;
+	bool m_lowMemory : 1;
+	bool m_handshakeMade : 1;
+	bool m_compressed : 1;
+	bool m_multiplexingOffered : 1;
+	/* members are ordered to avoid padding, flags are packed in one byte
+	 */
 };
 
 #endif /* CONNECTION_HPP */
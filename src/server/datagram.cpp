@@ -0,0 +1,360 @@
+#include "datagram.hpp"
+
+using namespace std;
+
+datagramBatch::datagramBatch() : m_received(0), m_queued(0), m_dropped(0){
+	m_inbound = new char[DATAGRAM_BATCH_SIZE * DATAGRAM_MAX_SIZE];
+	m_outbound = new char[DATAGRAM_BATCH_SIZE * DATAGRAM_MAX_SIZE];
+#ifdef UDP_SEGMENT
+	m_gso = true;
+#else
+	m_gso = false;
+#endif
+}
+
+datagramBatch::~datagramBatch(){
+	delete[] m_inbound;
+	delete[] m_outbound;
+}
+
+int32_t datagramBatch::receive(int32_t socket, bool blocking){
+	m_received = 0;
+	for (uint32_t i = 0; i < DATAGRAM_BATCH_SIZE; i++){
+		m_inboundVectors[i].iov_base = m_inbound + i * DATAGRAM_MAX_SIZE;
+		m_inboundVectors[i].iov_len = DATAGRAM_MAX_SIZE;
+		memset(&m_inboundHeaders[i], 0, sizeof(m_inboundHeaders[i]));
+		m_inboundHeaders[i].msg_hdr.msg_name = &m_inboundAddresses[i];
+		m_inboundHeaders[i].msg_hdr.msg_namelen = sizeof(m_inboundAddresses[i]);
+		m_inboundHeaders[i].msg_hdr.msg_iov = &m_inboundVectors[i];
+		m_inboundHeaders[i].msg_hdr.msg_iovlen = 1;
+	}
+	int ret = recvmmsg(socket, m_inboundHeaders, DATAGRAM_BATCH_SIZE, blocking ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+	if (ret == -1){
+		/* ECONNREFUSED reports an icmp error caused by a previous datagram, the socket is still usable */
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED){
+			return 0;
+		}
+		return -1;
+	}
+	m_received = ret;
+	return ret;
+}
+
+const char * datagramBatch::datagram(int32_t index, size_t * size, const sockaddr ** address, socklen_t * addressLength) const{
+	if (index < 0 || index >= m_received || (m_inboundHeaders[index].msg_hdr.msg_flags & MSG_TRUNC)){
+		return NULL;
+	}
+	*size = m_inboundHeaders[index].msg_len;
+	if (address != NULL){
+		*address = (const sockaddr *)&m_inboundAddresses[index];
+	}
+	if (addressLength != NULL){
+		*addressLength = m_inboundHeaders[index].msg_hdr.msg_namelen;
+	}
+	return m_inbound + index * DATAGRAM_MAX_SIZE;
+}
+
+bool datagramBatch::queue(int32_t socket, const sockaddr * address, socklen_t addressLength, const char * data, size_t size){
+	if (size > DATAGRAM_MAX_SIZE || addressLength > sizeof(struct sockaddr_storage)){
+		return false;
+	}
+	if (m_queued == DATAGRAM_BATCH_SIZE && !flush(socket)){
+		return false;
+	}
+	memcpy(m_outbound + m_queued * DATAGRAM_MAX_SIZE, data, size);
+	m_outboundSizes[m_queued] = size;
+	m_outboundAddressLengths[m_queued] = 0;
+	if (address != NULL){
+		memcpy(&m_outboundAddresses[m_queued], address, addressLength);
+		m_outboundAddressLengths[m_queued] = addressLength;
+	}
+	m_queued++;
+	return true;
+}
+
+bool datagramBatch::flush(int32_t socket){
+	uint32_t first = 0;
+	while (first < m_queued){
+		struct mmsghdr headers[DATAGRAM_BATCH_SIZE];
+		struct iovec vectors[DATAGRAM_BATCH_SIZE];
+		union {
+			char buffer[CMSG_SPACE(sizeof(uint16_t))];
+			struct cmsghdr align;
+		} control[DATAGRAM_BATCH_SIZE];
+		uint32_t starts[DATAGRAM_BATCH_SIZE + 1];
+		uint32_t messages = 0;
+		for (uint32_t i = first; i < m_queued;){
+			vectors[i].iov_base = m_outbound + i * DATAGRAM_MAX_SIZE;
+			vectors[i].iov_len = m_outboundSizes[i];
+			uint32_t count = 1;
+			if (m_gso && m_outboundSizes[i] <= DATAGRAM_GSO_MAX_SIZE){
+				/* every segment has the size of the first one, except the last one which can be smaller */
+				while (i + count < m_queued && count < DATAGRAM_GSO_MAX_SEGMENTS && m_outboundSizes[i + count] <= m_outboundSizes[i] && sameAddress(m_outboundAddresses[i], m_outboundAddressLengths[i], m_outboundAddresses[i + count], m_outboundAddressLengths[i + count])){
+					vectors[i + count].iov_base = m_outbound + (i + count) * DATAGRAM_MAX_SIZE;
+					vectors[i + count].iov_len = m_outboundSizes[i + count];
+					count++;
+					if (m_outboundSizes[i + count - 1] < m_outboundSizes[i]){
+						break;
+					}
+				}
+			}
+			struct msghdr * header = &headers[messages].msg_hdr;
+			memset(&headers[messages], 0, sizeof(headers[messages]));
+			if (m_outboundAddressLengths[i] != 0){
+				header->msg_name = &m_outboundAddresses[i];
+				header->msg_namelen = m_outboundAddressLengths[i];
+			}
+			header->msg_iov = &vectors[i];
+			header->msg_iovlen = count;
+#ifdef UDP_SEGMENT
+			if (count > 1){
+				header->msg_control = control[messages].buffer;
+				header->msg_controllen = sizeof(control[messages].buffer);
+				struct cmsghdr * cmsg = CMSG_FIRSTHDR(header);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t segmentSize = m_outboundSizes[i];
+				memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+			}
+#endif
+			starts[messages++] = i;
+			i += count;
+		}
+		starts[messages] = m_queued;
+		int ret = sendmmsg(socket, headers, messages, 0);
+		if (ret > 0){
+			first = starts[ret];
+		}
+		else if (errno == EINTR){
+			continue;
+		}
+		else if (m_gso && headers[0].msg_hdr.msg_iovlen > 1 && (errno == EIO || errno == EINVAL)){
+			/* GSO isn't supported by the device (no checksum offload for instance), datagrams are sent one by one from now */
+			m_gso = false;
+		}
+		else if (errno == EBADF || errno == ENOTSOCK){
+			m_dropped += m_queued - first;
+			m_queued = 0;
+			return false;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS){
+			/* the socket buffer is full, the remaining datagrams are dropped */
+			m_dropped += m_queued - first;
+			break;
+		}
+		else {
+			/* the first message can't be sent (unreachable peer for instance), it is dropped */
+			m_dropped += starts[1] - first;
+			first = starts[1];
+		}
+	}
+	m_queued = 0;
+	return true;
+}
+
+uint32_t datagramBatch::queued() const{
+	return m_queued;
+}
+
+uint64_t datagramBatch::dropped() const{
+	return m_dropped;
+}
+
+bool datagramBatch::sameAddress(const sockaddr_storage& a, socklen_t aLength, const sockaddr_storage& b, socklen_t bLength){
+	return aLength == bLength && memcmp(&a, &b, aLength) == 0;
+}
+
+datagramSession::datagramSession(datagramBatch * batch, int32_t socket, const sockaddr * address, socklen_t addressLength) : m_batch(batch), m_socket(socket), m_addressLength(0), m_ssl(NULL), m_inbound(NULL), m_id(-1), m_inactivityCounter(0), m_handshakeMade(false){
+	memset(&m_address, 0, sizeof(m_address));
+	if (address != NULL && addressLength <= sizeof(m_address)){
+		memcpy(&m_address, address, addressLength);
+		m_addressLength = addressLength;
+	}
+}
+
+datagramSession::~datagramSession(){
+	if (m_ssl != NULL){
+		SSL_free(m_ssl);
+	}
+}
+
+bool datagramSession::secure(SSL_CTX * sslContext, bool serverSide){
+	if (m_ssl != NULL || (m_ssl = SSL_new(sslContext)) == NULL){
+		return false;
+	}
+	m_inbound = BIO_new(BIO_s_mem());
+	BIO * outbound = BIO_new(bioMethod());
+	if (m_inbound == NULL || outbound == NULL){
+		BIO_free(m_inbound);
+		BIO_free(outbound);
+		SSL_free(m_ssl);
+		m_ssl = NULL;
+		m_inbound = NULL;
+		return false;
+	}
+	/* an empty inbound bio asks OpenSSL to retry later instead of reporting an end of file */
+	BIO_set_mem_eof_return(m_inbound, -1);
+	BIO_set_data(outbound, this);
+	BIO_set_init(outbound, 1);
+	SSL_set_bio(m_ssl, m_inbound, outbound);
+	SSL_set_app_data(m_ssl, this);
+	/* the mtu can't be queried through our bio */
+	SSL_set_options(m_ssl, SSL_OP_NO_QUERY_MTU);
+	SSL_set_mtu(m_ssl, DATAGRAM_MTU);
+	if (serverSide){
+		SSL_set_accept_state(m_ssl);
+	}
+	else {
+		SSL_set_connect_state(m_ssl);
+	}
+	return true;
+}
+
+int32_t datagramSession::handshake(){
+	if (m_ssl == NULL || m_handshakeMade){
+		return 1;
+	}
+	int ret = SSL_do_handshake(m_ssl);
+	if (ret == 1){
+		m_handshakeMade = true;
+		return 1;
+	}
+	int tmp = SSL_get_error(m_ssl, ret);
+	if (tmp != SSL_ERROR_WANT_READ && tmp != SSL_ERROR_WANT_WRITE){
+		return -1;
+	}
+	if (DTLSv1_handle_timeout(m_ssl) < 0){
+		return -1;
+	}
+	return 0;
+}
+
+int32_t datagramSession::listen(const char * datagram, size_t size, const sockaddr * address, socklen_t addressLength){
+	if (m_ssl == NULL || addressLength > sizeof(m_address)){
+		return -1;
+	}
+	memcpy(&m_address, address, addressLength);
+	m_addressLength = addressLength;
+	/* a previous datagram may have been dropped before being read */
+	BIO_reset(m_inbound);
+	if (BIO_write(m_inbound, datagram, size) != (int)size){
+		return -1;
+	}
+	BIO_ADDR * peer = BIO_ADDR_new();
+	if (peer == NULL){
+		return -1;
+	}
+	int ret = DTLSv1_listen(m_ssl, peer);
+	BIO_ADDR_free(peer);
+	return ret < 0 ? -1 : ret;
+}
+
+bool datagramSession::handshakeMade() const{
+	return m_ssl == NULL || m_handshakeMade;
+}
+
+ssize_t datagramSession::input(const char * datagram, size_t size, char * buffer, size_t capacity){
+	m_inactivityCounter = 0;
+	if (m_ssl == NULL){
+		if (size > capacity){
+			size = capacity;
+		}
+		memcpy(buffer, datagram, size);
+		return size;
+	}
+	if (BIO_write(m_inbound, datagram, size) != (int)size){
+		return -1;
+	}
+	if (!m_handshakeMade){
+		int32_t ret = handshake();
+		if (ret != 1){
+			return ret;
+		}
+	}
+	int ret = SSL_read(m_ssl, buffer, capacity);
+	if (ret > 0){
+		return ret;
+	}
+	int tmp = SSL_get_error(m_ssl, ret);
+	if (tmp == SSL_ERROR_WANT_READ || tmp == SSL_ERROR_WANT_WRITE){
+		return 0;
+	}
+	return -1;
+}
+
+bool datagramSession::output(const char * message, size_t size){
+	if (m_ssl == NULL){
+		return m_batch->queue(m_socket, m_addressLength != 0 ? (const sockaddr *)&m_address : NULL, m_addressLength, message, size);
+	}
+	if (!m_handshakeMade){
+		return false;
+	}
+	return SSL_write(m_ssl, message, size) > 0;
+}
+
+void datagramSession::close(){
+	if (m_ssl != NULL && m_handshakeMade){
+		SSL_shutdown(m_ssl);
+	}
+}
+
+const sockaddr * datagramSession::address() const{
+	return (const sockaddr *)&m_address;
+}
+
+socklen_t datagramSession::addressLength() const{
+	return m_addressLength;
+}
+
+void datagramSession::identify(int64_t id){
+	m_id = id;
+}
+
+int64_t datagramSession::id() const{
+	return m_id;
+}
+
+uint32_t datagramSession::countInactivity(){
+	return ++m_inactivityCounter;
+}
+
+SSL * datagramSession::ssl() const{
+	return m_ssl;
+}
+
+BIO_METHOD * datagramSession::bioMethod(){
+	/* created once and never freed, like the methods of OpenSSL */
+	static BIO_METHOD * method = NULL;
+	static once_flag created;
+	call_once(created, [](){
+		method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "datagram session");
+		BIO_meth_set_write(method, bioWrite);
+		BIO_meth_set_ctrl(method, bioControl);
+	});
+	return method;
+}
+
+int datagramSession::bioWrite(BIO * bio, const char * data, int size){
+	/* OpenSSL writes one datagram per call */
+	datagramSession * session = (datagramSession *)BIO_get_data(bio);
+	BIO_clear_retry_flags(bio);
+	if (size < 0 || !session->m_batch->queue(session->m_socket, session->m_addressLength != 0 ? (const sockaddr *)&session->m_address : NULL, session->m_addressLength, data, size)){
+		return -1;
+	}
+	return size;
+}
+
+long datagramSession::bioControl(BIO * bio, int command, long larg, void * parg){
+	(void)bio;
+	(void)larg;
+	(void)parg;
+	if (command == BIO_CTRL_FLUSH){
+		return 1;
+	}
+	if (command == BIO_CTRL_DGRAM_GET_MTU_OVERHEAD){
+		/* ipv6 and udp headers */
+		return 48;
+	}
+	return 0;
+}
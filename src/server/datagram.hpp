@@ -0,0 +1,135 @@
+#ifndef DATAGRAM_HPP
+#define DATAGRAM_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <openssl/ssl.h>
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+
+#define DATAGRAM_BATCH_SIZE 16
+#define DATAGRAM_MAX_SIZE 8448
+/* a message of MAX_BUFFER_SIZE bytes and the overhead of a dtls record
+ */
+#define DATAGRAM_MTU 1400
+/* size of the dtls handshake fragments
+ */
+#define DATAGRAM_GSO_MAX_SIZE 1400
+#define DATAGRAM_GSO_MAX_SEGMENTS 64
+/* only datagrams which fit in a network packet are coalesced with UDP GSO
+ */
+
+/* this class batches the datagrams read and written on a udp socket, it is shared by the datagramServer and datagramClient classes
+ * datagrams are received by groups of DATAGRAM_BATCH_SIZE with recvmmsg and queued datagrams are sent with sendmmsg
+ * consecutive datagrams of the same size sent to the same peer are coalesced in one GSO message if the kernel supports it
+ */
+class datagramBatch
+{
+public:
+	datagramBatch();
+	~datagramBatch();
+	int32_t receive(int32_t socket, bool blocking);
+	/* reads up to DATAGRAM_BATCH_SIZE datagrams (in blocking mode it waits for the first one)
+	 * returns the number of datagrams received (0 if none is waiting), -1 on error
+	 */
+	const char * datagram(int32_t index, size_t * size, const sockaddr ** address, socklen_t * addressLength) const;
+	/* returns the datagram index of the last receive call and stores its size and the address of its sender
+	 * returns NULL if the datagram has been truncated
+	 */
+	bool queue(int32_t socket, const sockaddr * address, socklen_t addressLength, const char * data, size_t size);
+	/* copies data in the send batch (address may be NULL on a connected socket), the batch is flushed when it is full
+	 * returns true on success, false otherwise
+	 */
+	bool flush(int32_t socket);
+	/* sends every queued datagram
+	 * datagrams which can't be sent because the socket buffer is full or the peer is unreachable are dropped
+	 * returns false if the socket can't be used anymore, true otherwise
+	 */
+	uint32_t queued() const;
+	uint64_t dropped() const;
+	/* returns the number of datagrams dropped by flush
+	 */
+private:
+	static bool sameAddress(const sockaddr_storage& a, socklen_t aLength, const sockaddr_storage& b, socklen_t bLength);
+	char * m_inbound;
+	struct mmsghdr m_inboundHeaders[DATAGRAM_BATCH_SIZE];
+	struct iovec m_inboundVectors[DATAGRAM_BATCH_SIZE];
+	struct sockaddr_storage m_inboundAddresses[DATAGRAM_BATCH_SIZE];
+	int32_t m_received;
+	char * m_outbound;
+	size_t m_outboundSizes[DATAGRAM_BATCH_SIZE];
+	struct sockaddr_storage m_outboundAddresses[DATAGRAM_BATCH_SIZE];
+	socklen_t m_outboundAddressLengths[DATAGRAM_BATCH_SIZE];
+	uint32_t m_queued;
+	uint64_t m_dropped;
+	bool m_gso;
+};
+
+/* this class holds the state of one peer of a udp socket : its address, its id and its dtls state
+ * records produced by OpenSSL are queued in the datagramBatch one datagram per record write, and received datagrams are
+ * given to OpenSSL one at a time, so one udp socket can serve every peer
+ */
+class datagramSession
+{
+public:
+	datagramSession(datagramBatch * batch, int32_t socket, const sockaddr * address, socklen_t addressLength);
+	/* address may be NULL on a connected socket
+	 */
+	~datagramSession();
+	bool secure(SSL_CTX * sslContext, bool serverSide);
+	/* enables dtls on the session, sslContext must use a DTLS method
+	 * returns true on success, false otherwise
+	 */
+	int32_t handshake();
+	/* progresses the dtls handshake and retransmits the last flight if its timer expired
+	 * returns 1 when the handshake is made, 0 if it is still in progress, -1 on error
+	 */
+	int32_t listen(const char * datagram, size_t size, const sockaddr * address, socklen_t addressLength);
+	/* checks the cookie of a ClientHello from address without keeping any state (server side, secure must have been called)
+	 * a ClientHello without a valid cookie is answered with a HelloVerifyRequest, the session then takes the address of the peer
+	 * returns 1 if the cookie is valid (handshake continues the handshake), 0 if the datagram is answered or dropped, -1 on error
+	 */
+	bool handshakeMade() const;
+	ssize_t input(const char * datagram, size_t size, char * buffer, size_t capacity);
+	/* processes a received datagram and stores the message it contains in buffer
+	 * returns the size of the message (0 if the datagram carried no message, dtls handshake for instance), -1 on error
+	 */
+	bool output(const char * message, size_t size);
+	/* queues message in the batch (in a dtls record if dtls is enabled)
+	 * returns true on success, false otherwise
+	 */
+	void close();
+	/* sends a dtls close_notify alert if the handshake has been made
+	 */
+	const sockaddr * address() const;
+	socklen_t addressLength() const;
+	void identify(int64_t id);
+	int64_t id() const;
+	uint32_t countInactivity();
+	/* increments and returns the number of calls since the last datagram received
+	 */
+	SSL * ssl() const;
+private:
+	static BIO_METHOD * bioMethod();
+	static int bioWrite(BIO * bio, const char * data, int size);
+	static long bioControl(BIO * bio, int command, long larg, void * parg);
+	datagramBatch * m_batch;
+	int32_t m_socket;
+	struct sockaddr_storage m_address;
+	socklen_t m_addressLength;
+	SSL * m_ssl;
+	BIO * m_inbound;
+	int64_t m_id;
+	uint32_t m_inactivityCounter;
+	bool m_handshakeMade;
+};
+
+#endif /* DATAGRAM_HPP */
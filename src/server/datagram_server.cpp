@@ -0,0 +1,322 @@
+#include "datagram_server.hpp"
+
+using namespace std;
+
+datagramServer::datagramServer(uint16_t port, uint32_t maxSessions, bool dtlsMode, bool blocking, uint32_t maxInactivityCounter, const string& pathToKeyFile, const string& pathToCertFile) : m_dtlsMode(dtlsMode), m_blocking(blocking), m_port(port), m_ipv6(false), m_dualStack(false), m_mainSocket(-1), m_sslContext(NULL), m_pathToKeyFile(pathToKeyFile), m_pathToCertFile(pathToCertFile), m_maxSessions(maxSessions), m_maxInactivityCounter(maxInactivityCounter), m_listener(NULL), m_batch(NULL){
+	if (dtlsMode){
+		SSL_library_init();
+	}
+	memset(m_cookieSecret, 0, sizeof(m_cookieSecret));
+}
+
+datagramServer::~datagramServer(){
+	shutdown();
+}
+
+void datagramServer::useIPv6(bool dualStack){
+	m_ipv6 = true;
+	m_dualStack = dualStack;
+}
+
+bool datagramServer::launch(){
+	try {
+		if (m_mainSocket != -1){
+			throw serverError("server is already launched", ERROR_SERVER_LAUNCH);
+		}
+		struct sockaddr_storage serverAddress;
+		socklen_t serverAddressLength;
+		memset(&serverAddress, 0, sizeof(serverAddress));
+		if (m_ipv6){
+			struct sockaddr_in6 * address = (struct sockaddr_in6 *)&serverAddress;
+			address->sin6_family = AF_INET6;
+			address->sin6_port = htons(m_port);
+			address->sin6_addr = in6addr_any;
+			serverAddressLength = sizeof(struct sockaddr_in6);
+		}
+		else {
+			struct sockaddr_in * address = (struct sockaddr_in *)&serverAddress;
+			address->sin_family = AF_INET;
+			address->sin_port = htons(m_port);
+			address->sin_addr.s_addr = htonl(INADDR_ANY);
+			serverAddressLength = sizeof(struct sockaddr_in);
+		}
+		if ((m_mainSocket = socket(serverAddress.ss_family, SOCK_DGRAM, 0)) == -1){
+			throw serverError("can't create socket", ERROR_SERVER_LAUNCH);
+		}
+		if (m_ipv6){
+			int v6only = m_dualStack ? 0 : 1;
+			if (setsockopt(m_mainSocket, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1){
+				throw serverError("can't set IPV6_V6ONLY", ERROR_SERVER_LAUNCH);
+			}
+		}
+		if (!m_blocking){
+			int options;
+			if ((options = fcntl(m_mainSocket, F_GETFL)) == -1){
+				throw serverError("fcntl error", ERROR_SERVER_LAUNCH);
+			}
+			if (fcntl(m_mainSocket, F_SETFL, options | O_NONBLOCK) == -1){
+				throw serverError("fcntl error", ERROR_SERVER_LAUNCH);
+			}
+		}
+		if (bind(m_mainSocket, (sockaddr *)&serverAddress, serverAddressLength) != 0){
+			throw serverError("can't bind socket", ERROR_SERVER_LAUNCH);
+		}
+		if (m_dtlsMode){
+			if ((m_sslContext = SSL_CTX_new(DTLS_server_method())) == NULL){
+				throw serverError("can't create a SSL_CTX", ERROR_SERVER_LAUNCH);
+			}
+			if (SSL_CTX_set_min_proto_version(m_sslContext, DTLS1_2_VERSION) == 0){
+				throw serverError("SSL_CTX_set_min_proto_version error", ERROR_SERVER_LAUNCH);
+			}
+			if (SSL_CTX_use_PrivateKey_file(m_sslContext, m_pathToKeyFile.c_str(), SSL_FILETYPE_PEM) != 1){
+				throw serverError("SSL_CTX_use_PrivateKey_file error", ERROR_SERVER_LAUNCH);
+			}
+			if (SSL_CTX_use_certificate_file(m_sslContext, m_pathToCertFile.c_str(), SSL_FILETYPE_PEM) != 1){
+				throw serverError("SSL_CTX_use_certificate_file error", ERROR_SERVER_LAUNCH);
+			}
+			SSL_CTX_set_verify(m_sslContext, SSL_VERIFY_NONE, NULL);
+			if (RAND_bytes(m_cookieSecret, sizeof(m_cookieSecret)) != 1){
+				throw serverError("can't generate the cookie secret", ERROR_SERVER_LAUNCH);
+			}
+			SSL_CTX_set_app_data(m_sslContext, this);
+			SSL_CTX_set_options(m_sslContext, SSL_OP_COOKIE_EXCHANGE);
+			SSL_CTX_set_cookie_generate_cb(m_sslContext, generateCookie);
+			SSL_CTX_set_cookie_verify_cb(m_sslContext, verifyCookie);
+		}
+		m_batch = new datagramBatch();
+		if (m_dtlsMode && !renewListener()){
+			throw serverError("can't create the dtls listener", ERROR_SERVER_LAUNCH);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+void datagramServer::shutdown(){
+	while (!m_sessions.empty()){
+		dropSession(m_sessions.begin());
+	}
+	if (m_listener != NULL){
+		delete m_listener;
+		m_listener = NULL;
+	}
+	if (m_batch != NULL){
+		m_batch->flush(m_mainSocket);
+		delete m_batch;
+		m_batch = NULL;
+	}
+	if (m_mainSocket != -1){
+		close(m_mainSocket);
+		m_mainSocket = -1;
+	}
+	if (m_sslContext != NULL){
+		SSL_CTX_free(m_sslContext);
+		m_sslContext = NULL;
+	}
+}
+
+uint32_t datagramServer::maxSessions() const{
+	return m_maxSessions;
+}
+
+uint32_t datagramServer::activeSessions() const{
+	return m_sessions.size();
+}
+
+uint64_t datagramServer::droppedDatagrams() const{
+	if (m_batch == NULL){
+		return 0;
+	}
+	return m_batch->dropped();
+}
+
+void datagramServer::handshakeSessions(){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to handshake on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		if (!m_dtlsMode){
+			throw serverError("trying to handshake on an non-dtls server", ERROR_SERVER_NOT_TLS);
+		}
+		for (auto i = m_sessions.begin(); i != m_sessions.end();){
+			auto j = i;
+			j++;
+			if (!i->second->handshakeMade() && i->second->handshake() == -1){
+				dropSession(i);
+			}
+			i = j;
+		}
+		m_batch->flush(m_mainSocket);
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+}
+
+void datagramServer::cleanupSessions(){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to cleanup sessions on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		if (m_maxInactivityCounter == 0){
+			return;
+		}
+		for (auto i = m_sessions.begin(); i != m_sessions.end();){
+			auto j = i;
+			j++;
+			if (i->second->countInactivity() >= m_maxInactivityCounter){
+				dropSession(i);
+			}
+			i = j;
+		}
+		m_batch->flush(m_mainSocket);
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+}
+
+void datagramServer::readFromSessions(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to read from sessions on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		char * buffer = (char*) malloc(sizeof(char) * MAX_BUFFER_SIZE);
+		bool blocking = m_blocking;
+		int32_t received;
+		/* a batch which isn't full means the socket has been drained */
+		while ((received = m_batch->receive(m_mainSocket, blocking)) > 0){
+			blocking = false;
+			for (int32_t k = 0; k < received; k++){
+				size_t size = 0;
+				const sockaddr * address = NULL;
+				socklen_t addressLength = 0;
+				const char * datagram = m_batch->datagram(k, &size, &address, &addressLength);
+				if (datagram == NULL){
+					continue;
+				}
+				string key = sessionKey(address, addressLength);
+				auto i = m_sessions.find(key);
+				if (i == m_sessions.end()){
+					if (m_sessions.size() >= m_maxSessions){
+						continue;
+					}
+					if (m_dtlsMode){
+						/* the listener becomes the session of a peer whose cookie is valid */
+						if ((m_listener == NULL && !renewListener()) || m_listener->listen(datagram, size, address, addressLength) != 1){
+							continue;
+						}
+						i = m_sessions.insert(make_pair(key, m_listener)).first;
+						m_listener = NULL;
+						if (i->second->handshake() == -1){
+							dropSession(i);
+						}
+						continue;
+					}
+					i = m_sessions.insert(make_pair(key, new datagramSession(m_batch, m_mainSocket, address, addressLength))).first;
+				}
+				memset(buffer, 0, sizeof(char) * MAX_BUFFER_SIZE);
+				ssize_t ret = i->second->input(datagram, size, buffer, MAX_BUFFER_SIZE);
+				if (ret == -1){
+					dropSession(i);
+					continue;
+				}
+				if (ret == 0 || callback == NULL){
+					continue;
+				}
+				bool response = false;
+				int64_t tmp = callback(i->second->id(), buffer, data, &response);
+				if (tmp > 0){
+					i->second->identify(tmp);
+				}
+				else if (tmp == -1){
+					dropSession(i);
+					continue;
+				}
+				if (response){
+					i->second->output(buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+				}
+			}
+			if (received < DATAGRAM_BATCH_SIZE){
+				break;
+			}
+		}
+		free(buffer);
+		if (!m_batch->flush(m_mainSocket) || received == -1){
+			throw serverError("error while reading from sessions", ERROR_CLIENT_READ);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+}
+
+void datagramServer::writeToSessions(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to write to sessions on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		char * buffer = (char*) malloc(sizeof(char) * MAX_BUFFER_SIZE);
+		for (auto i = m_sessions.begin(); i != m_sessions.end(); i++){
+			if (!i->second->handshakeMade()){
+				continue;
+			}
+			memset(buffer, 0, sizeof(char) * MAX_BUFFER_SIZE);
+			if (callback != NULL && callback(i->second->id(), buffer, data)){
+				i->second->output(buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+			}
+		}
+		free(buffer);
+		if (!m_batch->flush(m_mainSocket)){
+			throw serverError("error while writing to sessions", ERROR_CLIENT_WRITE);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+}
+
+string datagramServer::sessionKey(const sockaddr * address, socklen_t addressLength){
+	return string((const char *)address, addressLength);
+}
+
+int datagramServer::generateCookie(SSL * ssl, unsigned char * cookie, unsigned int * cookieLength){
+	datagramSession * session = (datagramSession *)SSL_get_app_data(ssl);
+	datagramServer * owner = (datagramServer *)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	if (session == NULL || owner == NULL){
+		return 0;
+	}
+	if (HMAC(EVP_sha256(), owner->m_cookieSecret, sizeof(owner->m_cookieSecret), (const unsigned char *)session->address(), session->addressLength(), cookie, cookieLength) == NULL){
+		return 0;
+	}
+	return 1;
+}
+
+int datagramServer::verifyCookie(SSL * ssl, const unsigned char * cookie, unsigned int cookieLength){
+	unsigned char expected[EVP_MAX_MD_SIZE];
+	unsigned int expectedLength = 0;
+	if (generateCookie(ssl, expected, &expectedLength) != 1 || expectedLength != cookieLength){
+		return 0;
+	}
+	return CRYPTO_memcmp(expected, cookie, cookieLength) == 0;
+}
+
+bool datagramServer::renewListener(){
+	m_listener = new datagramSession(m_batch, m_mainSocket, NULL, 0);
+	if (!m_listener->secure(m_sslContext, true)){
+		delete m_listener;
+		m_listener = NULL;
+		return false;
+	}
+	return true;
+}
+
+void datagramServer::dropSession(map<string, datagramSession*>::iterator i){
+	i->second->close();
+	delete i->second;
+	m_sessions.erase(i);
+}
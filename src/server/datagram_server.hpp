@@ -0,0 +1,112 @@
+#ifndef DATAGRAM_SERVER_HPP
+#define DATAGRAM_SERVER_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+
+#include "connection.hpp"
+#include "datagram.hpp"
+#include "error.hpp"
+
+#define DATAGRAM_COOKIE_SECRET_SIZE 32
+
+/* this class is used to setup a udp server for traffic which tolerates loss but not head of line blocking
+ * every peer address gets a session which is identified like a connection of the server class (id -1 by default)
+ * sessions can be cyphered with dtls (DTLS 1.2, OpenSSL doesn't support DTLS 1.3 yet) using the same key and certificate files
+ */
+class datagramServer
+{
+public:
+	datagramServer(uint16_t port, uint32_t maxSessions, bool dtlsMode, bool blocking, uint32_t maxInactivityCounter = 0, const std::string& pathToKeyFile = "", const std::string& pathToCertFile = "");
+	/* port : the port of the server
+	 * maxSessions : the maximum number of peers handled simultaneously, datagrams of other peers are dropped
+	 * (in dtls mode a peer only gets a session once it has echoed its cookie, so spoofed addresses can't fill the sessions)
+	 * dtlsMode : enabled : datagrams are cyphered with dtls, disabled : plain datagrams
+	 * blocking : readFromSessions waits for at least one datagram
+	 * maxInactivityCounter : maximum number of calls to cleanupSessions without any datagram from a peer before its session is dropped (0 to never drop)
+	 * pathToKeyFile : path to the encryption key used (dtls mode)
+	 * pathToCertFile : path to the certificate used (dtls mode)
+	 */
+	~datagramServer();
+	void useIPv6(bool dualStack = true);
+	/* listen on an IPv6 socket instead of IPv4, if dualStack is true IPv4 peers are accepted too
+	 * must be called before launch
+	 */
+	bool launch();
+	/* launches the server, must be called before any other call
+	 * returns true on success, false otherwise
+	 */
+	void shutdown();
+	/* shutdowns the server and drops every session
+	 */
+	uint32_t maxSessions() const;
+	uint32_t activeSessions() const;
+	/* returns the number of peers currently handled
+	 */
+	uint64_t droppedDatagrams() const;
+	/* returns the number of datagrams which couldn't be sent
+	 */
+	void handshakeSessions();
+	/* retransmits the handshake messages of dtls sessions whose timer expired, sessions whose handshake failed are dropped
+	 */
+	void cleanupSessions();
+	/* drops sessions which haven't sent a single datagram for maxInactivityCounter calls
+	 */
+	void readFromSessions(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data);
+	/* reads every waiting datagram by batches of DATAGRAM_BATCH_SIZE and calls the callback for each message with :
+	 * the session id as an int64_t (-1 default for a new peer)
+	 * a buffer with the message received
+	 * the pointer data is passed to callback as a void *
+	 * a pointer to a boolean, if callback returns >= 0 and this boolean is true, content of buffer is sent back to the peer
+	 * the callback must return an int64_t which is the new session id (0 for unchanged, -1 will drop the session, positive will change session id)
+	 * responses are sent in batches once every datagram has been read
+	 */
+	void writeToSessions(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data);
+	/* calls a callback for each session (whose handshake is made) with :
+	 * the session id as an int64_t
+	 * a buffer with the message to be sent
+	 * the pointer data is passed to callback as a void *
+	 * if the callback returns true buffer is sent to the peer, otherwise nothing is done
+	 */
+private:
+	static std::string sessionKey(const sockaddr * address, socklen_t addressLength);
+	static int generateCookie(SSL * ssl, unsigned char * cookie, unsigned int * cookieLength);
+	static int verifyCookie(SSL * ssl, const unsigned char * cookie, unsigned int cookieLength);
+	bool renewListener();
+	void dropSession(std::map<std::string, datagramSession*>::iterator i);
+	bool m_dtlsMode;
+	bool m_blocking;
+	uint16_t m_port;
+	bool m_ipv6;
+	bool m_dualStack;
+	int32_t m_mainSocket;
+	SSL_CTX * m_sslContext;
+	std::string m_pathToKeyFile;
+	std::string m_pathToCertFile;
+	uint32_t m_maxSessions;
+	uint32_t m_maxInactivityCounter;
+	unsigned char m_cookieSecret[DATAGRAM_COOKIE_SECRET_SIZE];
+	/* dtls cookies are a hmac of the peer address, so spoofed addresses can't trigger the sending of the certificate
+	 */
+	datagramSession * m_listener;
+	/* answers the ClientHellos of unknown peers without allocating anything until their cookie is verified,
+	 * its dtls state becomes the session of the peer then
+	 */
+	datagramBatch * m_batch;
+	std::map<std::string, datagramSession*> m_sessions;
+};
+
+#endif /* DATAGRAM_SERVER_HPP */
@@ -29,6 +29,12 @@ serverError::serverError(const std::string& s, uint16_t errorType) : m_errorType
 	else if (m_errorType == ERROR_CLIENT_WRITE){
 		errorMessage += "Client write failed";
 	}
+	else if (m_errorType == ERROR_SERVER_COMPRESSION){
+		errorMessage += "Compression setup failed";
+	}
+	else if (m_errorType == ERROR_SERVER_HANDOVER){
+		errorMessage += "Listening socket handover failed";
+	}
 	else {
 		errorMessage += "unknown error";
 	}
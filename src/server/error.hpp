@@ -1,5 +1,5 @@
-#ifndef ERROR_HPP
-#define ERROR_HPP
+#ifndef SERVER_ERROR_HPP
+#define SERVER_ERROR_HPP
 
 #include <unistd.h>
 #include <string.h>
@@ -14,7 +14,11 @@
 #define ERROR_SERVER_NOT_LAUNCHED 5
 #define ERROR_SERVER_NOT_TLS 6
 #define ERROR_SERVER_FULL 7
+#ifndef ERROR_CLIENT_WRITE
 #define ERROR_CLIENT_WRITE 8
+#endif
+#define ERROR_SERVER_COMPRESSION 9
+#define ERROR_SERVER_HANDOVER 10
 
 
 /* this class handles error output for the server and connection classes
@@ -32,4 +36,4 @@ private:
 	uint32_t errtmp;
 };
 
-#endif /* ERROR_HPP */
+#endif /* SERVER_ERROR_HPP */
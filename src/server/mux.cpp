@@ -0,0 +1,232 @@
+#include "mux.hpp"
+
+using namespace std;
+
+muxSession::muxSession(bool initiator) : m_cursor(0), m_nextStream(initiator ? 1 : 2){
+
+}
+
+muxSession::~muxSession(){
+
+}
+
+void muxSession::makeHello(char hello[MUX_HELLO_SIZE], uint32_t version){
+	memcpy(hello, MUX_HELLO_MAGIC, 4);
+	uint32_t tmp = htonl(version);
+	memcpy(hello + 4, &tmp, sizeof(tmp));
+}
+
+bool muxSession::isHello(const char * message, size_t size, uint32_t * version){
+	if (size != MUX_HELLO_SIZE || memcmp(message, MUX_HELLO_MAGIC, 4) != 0){
+		return false;
+	}
+	uint32_t tmp;
+	memcpy(&tmp, message + 4, sizeof(tmp));
+	*version = ntohl(tmp);
+	return true;
+}
+
+uint32_t muxSession::openStream(){
+	uint32_t id = m_nextStream;
+	m_nextStream += 2;
+	getStream(id);
+	return id;
+}
+
+bool muxSession::queue(uint32_t stream, const char * message, size_t size){
+	if (size == 0 || size > MUX_MAX_MESSAGE_SIZE){
+		return false;
+	}
+	getStream(stream).outbound.push_back(string(message, size));
+	return true;
+}
+
+void muxSession::close(uint32_t stream){
+	if (m_streams.erase(stream) != 0){
+		control(stream, MUX_FRAME_CLOSE, 0, false);
+	}
+}
+
+size_t muxSession::produce(char * buffer, size_t capacity){
+	size_t used = 0;
+	/* control frames are small and unblock the peer, they are sent first */
+	size_t controlSize = 0;
+	while (controlSize + MUX_HEADER_SIZE <= m_control.size()){
+		uint16_t length;
+		memcpy(&length, m_control.data() + controlSize + 6, sizeof(length));
+		size_t frameSize = MUX_HEADER_SIZE + ntohs(length);
+		if (controlSize + frameSize > capacity){
+			break;
+		}
+		controlSize += frameSize;
+	}
+	memcpy(buffer, m_control.data(), controlSize);
+	m_control.erase(0, controlSize);
+	used += controlSize;
+	bool progress = true;
+	while (progress && used + MUX_HEADER_SIZE < capacity){
+		progress = false;
+		/* one frame per stream in turn, starting after the last stream served */
+		auto i = m_streams.upper_bound(m_cursor);
+		for (size_t visited = 0; visited < m_streams.size() && used + MUX_HEADER_SIZE < capacity; visited++, i++){
+			if (i == m_streams.end()){
+				i = m_streams.begin();
+			}
+			stream& s = i->second;
+			if (s.outbound.empty() || s.sendWindow == 0){
+				continue;
+			}
+			const string& message = s.outbound.front();
+			size_t length = message.size() - s.offset;
+			if (length > MUX_FRAME_SIZE){
+				length = MUX_FRAME_SIZE;
+			}
+			if (length > s.sendWindow){
+				length = s.sendWindow;
+			}
+			if (length > capacity - used - MUX_HEADER_SIZE){
+				length = capacity - used - MUX_HEADER_SIZE;
+			}
+			bool end = s.offset + length == message.size();
+			writeHeader(buffer + used, i->first, MUX_FRAME_DATA, end ? MUX_FLAG_END : 0, length);
+			memcpy(buffer + used + MUX_HEADER_SIZE, message.data() + s.offset, length);
+			used += MUX_HEADER_SIZE + length;
+			s.sendWindow -= length;
+			s.offset += length;
+			if (end){
+				s.outbound.pop_front();
+				s.offset = 0;
+			}
+			m_cursor = i->first;
+			progress = true;
+		}
+	}
+	return used;
+}
+
+bool muxSession::consume(const char * data, size_t size){
+	m_input.append(data, size);
+	size_t position = 0;
+	while (position + MUX_HEADER_SIZE <= m_input.size()){
+		const char * header = m_input.data() + position;
+		uint32_t id;
+		uint16_t length;
+		memcpy(&id, header, sizeof(id));
+		memcpy(&length, header + 6, sizeof(length));
+		id = ntohl(id);
+		length = ntohs(length);
+		uint8_t type = header[4];
+		uint8_t flags = header[5];
+		if (length > MUX_FRAME_SIZE){
+			return false;
+		}
+		if (position + MUX_HEADER_SIZE + length > m_input.size()){
+			break;
+		}
+		const char * payload = header + MUX_HEADER_SIZE;
+		if (type == MUX_FRAME_DATA){
+			if (m_streams.size() >= MUX_MAX_STREAMS && m_streams.find(id) == m_streams.end()){
+				return false;
+			}
+			stream& s = getStream(id);
+			s.receivedWindow += length;
+			s.inbound.append(payload, length);
+			if (s.receivedWindow > MUX_INITIAL_WINDOW || s.inbound.size() > MUX_MAX_MESSAGE_SIZE){
+				return false;
+			}
+			if (flags & MUX_FLAG_END){
+				m_received.push_back(make_pair(id, s.inbound));
+				s.inbound.clear();
+			}
+		}
+		else if (type == MUX_FRAME_WINDOW && length == sizeof(uint32_t)){
+			auto i = m_streams.find(id);
+			if (i != m_streams.end()){
+				uint32_t increment;
+				memcpy(&increment, payload, sizeof(increment));
+				/* credit beyond 2^32 bytes can't come from a well behaved peer */
+				if ((uint64_t)i->second.sendWindow + ntohl(increment) > UINT32_MAX){
+					return false;
+				}
+				i->second.sendWindow += ntohl(increment);
+			}
+		}
+		else if (type == MUX_FRAME_CLOSE){
+			m_streams.erase(id);
+		}
+		else {
+			return false;
+		}
+		position += MUX_HEADER_SIZE + length;
+	}
+	m_input.erase(0, position);
+	return true;
+}
+
+bool muxSession::next(uint32_t * stream, char * message, size_t * size){
+	if (m_received.empty()){
+		return false;
+	}
+	pair<uint32_t, string>& front = m_received.front();
+	*stream = front.first;
+	*size = front.second.size();
+	memcpy(message, front.second.data(), front.second.size());
+	auto i = m_streams.find(front.first);
+	if (i != m_streams.end()){
+		i->second.receivedWindow -= front.second.size();
+		control(front.first, MUX_FRAME_WINDOW, front.second.size(), true);
+	}
+	m_received.pop_front();
+	return true;
+}
+
+bool muxSession::pending() const{
+	if (!m_control.empty()){
+		return true;
+	}
+	for (auto i = m_streams.begin(); i != m_streams.end(); i++){
+		if (!i->second.outbound.empty() && i->second.sendWindow != 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t muxSession::streams() const{
+	return m_streams.size();
+}
+
+size_t muxSession::received() const{
+	return m_received.size();
+}
+
+void muxSession::writeHeader(char * header, uint32_t stream, uint8_t type, uint8_t flags, uint16_t length){
+	uint32_t id = htonl(stream);
+	length = htons(length);
+	memcpy(header, &id, sizeof(id));
+	header[4] = type;
+	header[5] = flags;
+	memcpy(header + 6, &length, sizeof(length));
+}
+
+muxSession::stream& muxSession::getStream(uint32_t id){
+	auto i = m_streams.find(id);
+	if (i == m_streams.end()){
+		stream s;
+		s.offset = 0;
+		s.sendWindow = MUX_INITIAL_WINDOW;
+		s.receivedWindow = 0;
+		i = m_streams.insert(make_pair(id, s)).first;
+	}
+	return i->second;
+}
+
+void muxSession::control(uint32_t stream, uint8_t type, uint32_t value, bool hasValue){
+	char frame[MUX_HEADER_SIZE + sizeof(uint32_t)];
+	writeHeader(frame, stream, type, 0, hasValue ? sizeof(uint32_t) : 0);
+	if (hasValue){
+		value = htonl(value);
+		memcpy(frame + MUX_HEADER_SIZE, &value, sizeof(value));
+	}
+	m_control.append(frame, MUX_HEADER_SIZE + (hasValue ? sizeof(uint32_t) : 0));
+}
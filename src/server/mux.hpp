@@ -0,0 +1,110 @@
+#ifndef MUX_HPP
+#define MUX_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <cstdint>
+#include <map>
+#include <deque>
+
+#define MUX_HEADER_SIZE 8
+/* frame header : stream id (4 bytes, network order), type (1 byte), flags (1 byte), payload length (2 bytes, network order)
+ */
+#define MUX_FRAME_DATA 0
+#define MUX_FRAME_WINDOW 1
+#define MUX_FRAME_CLOSE 2
+#define MUX_FLAG_END 1
+/* set on the last data frame of a message
+ */
+#define MUX_FRAME_SIZE 4096
+/* largest data payload, streams are interleaved frame by frame
+ */
+#define MUX_INITIAL_WINDOW 65536
+/* bytes a stream can send before the receiver gives credit back
+ */
+#define MUX_MAX_MESSAGE_SIZE 8192
+#define MUX_MAX_STREAMS 1024
+/* streams the peer can open at the same time
+ */
+#define MUX_HELLO_SIZE 8
+#define MUX_HELLO_MAGIC "\0TLM"
+#define MUX_VERSION 1
+
+/* this class multiplexes numbered streams of messages over one connection, it is shared by the connection and client classes
+ * messages are cut in frames of at most MUX_FRAME_SIZE bytes sent in round robin between the streams which have data and credit left,
+ * so a large message doesn't delay the other streams
+ * each stream can only have MUX_INITIAL_WINDOW bytes in flight, credit is given back once messages are read by the application
+ */
+class muxSession
+{
+public:
+	muxSession(bool initiator);
+	/* initiator : the side which opens streams with odd ids (client), the other side uses even ids
+	 */
+	~muxSession();
+	static void makeHello(char hello[MUX_HELLO_SIZE], uint32_t version);
+	static bool isHello(const char * message, size_t size, uint32_t * version);
+	/* returns true if message is a negotiation message, the version it contains (0 for a refusal) is stored in version
+	 */
+	uint32_t openStream();
+	/* returns the id of a new stream
+	 */
+	bool queue(uint32_t stream, const char * message, size_t size);
+	/* queues message on stream, it is sent by produce
+	 * returns false if the message is empty or larger than MUX_MAX_MESSAGE_SIZE
+	 */
+	void close(uint32_t stream);
+	/* drops the data queued on stream and tells the peer
+	 */
+	size_t produce(char * buffer, size_t capacity);
+	/* writes in buffer the frames which can be sent (credit updates first, then one data frame per stream in turn)
+	 * returns the number of bytes written
+	 */
+	bool consume(const char * data, size_t size);
+	/* parses bytes received from the peer (frames can be split between calls)
+	 * returns false if the peer doesn't respect the protocol
+	 */
+	bool next(uint32_t * stream, char * message, size_t * size);
+	/* stores the next complete message received in message (at least MUX_MAX_MESSAGE_SIZE bytes) and gives its credit back
+	 * returns false if no message is waiting
+	 */
+	bool pending() const;
+	/* returns true if produce has something to send
+	 */
+	size_t streams() const;
+	/* returns the number of open streams
+	 */
+	size_t received() const;
+	/* returns the number of complete messages waiting to be returned by next
+	 */
+private:
+	struct stream
+	{
+		std::deque<std::string> outbound;
+		size_t offset;
+		/* bytes of the first outbound message already sent
+		 */
+		uint32_t sendWindow;
+		uint32_t receivedWindow;
+		/* bytes received and not credited yet
+		 */
+		std::string inbound;
+		/* partial message being received
+		 */
+	};
+	static void writeHeader(char * header, uint32_t stream, uint8_t type, uint8_t flags, uint16_t length);
+	stream& getStream(uint32_t id);
+	void control(uint32_t stream, uint8_t type, uint32_t value, bool hasValue);
+	std::map<uint32_t, stream> m_streams;
+	std::string m_input;
+	std::string m_control;
+	std::deque<std::pair<uint32_t, std::string> > m_received;
+	uint32_t m_cursor;
+	uint32_t m_nextStream;
+};
+
+#endif /* MUX_HPP */
@@ -0,0 +1,184 @@
+#include "outbound.hpp"
+
+using namespace std;
+
+outboundQueue::outboundQueue(){
+
+}
+
+outboundQueue::~outboundQueue(){
+	clear();
+}
+
+bool outboundQueue::pushFile(int32_t fd, off_t offset, size_t len){
+	struct stat fileStat;
+	if (fd < 0 || offset < 0 || fstat(fd, &fileStat) == -1 || offset >= fileStat.st_size){
+		return false;
+	}
+	if (len == 0){
+		len = fileStat.st_size - offset;
+	}
+	/* bytes past the end of the file would never come */
+	else if (len > (size_t)(fileStat.st_size - offset)){
+		return false;
+	}
+	entry e;
+	e.fd = fd;
+	e.offset = offset;
+	e.remaining = len;
+	e.copied = false;
+	m_entries.push_back(e);
+	return true;
+}
+
+void outboundQueue::pushMessage(const char * buffer, size_t size){
+	if (size == 0){
+		return;
+	}
+	entry e;
+	e.fd = -1;
+	e.offset = 0;
+	e.remaining = size;
+	e.copied = true;
+	m_entries.push_back(e);
+	m_entries.back().chunk.assign(buffer, size);
+}
+
+int32_t outboundQueue::progress(int32_t socket, SSL * ssl, int32_t * completedFd){
+	if (m_entries.empty()){
+		return 0;
+	}
+	entry& e = m_entries.front();
+	ssize_t ret;
+	if (e.copied){
+		ret = sendChunk(socket, ssl, e);
+	}
+	else if (ssl != NULL){
+		ret = sendTls(ssl, e);
+	}
+	else {
+		ret = sendPlain(socket, e);
+	}
+	if (ret < 0){
+		return -1;
+	}
+	e.remaining -= ret;
+	if (e.remaining != 0){
+		return 0;
+	}
+	if (completedFd != NULL){
+		*completedFd = e.fd;
+	}
+	m_entries.pop_front();
+	return 1;
+}
+
+bool outboundQueue::empty() const{
+	return m_entries.empty();
+}
+
+bool outboundQueue::frontIsMessage() const{
+	return !m_entries.empty() && m_entries.front().fd == -1;
+}
+
+size_t outboundQueue::pendingBytes() const{
+	size_t total = 0;
+	for (auto i = m_entries.begin(); i != m_entries.end(); i++){
+		total += i->remaining;
+	}
+	return total;
+}
+
+size_t outboundQueue::memoryUsage() const{
+	size_t total = sizeof(outboundQueue);
+	for (auto i = m_entries.begin(); i != m_entries.end(); i++){
+		total += sizeof(entry) + 2 * sizeof(void *) + i->chunk.capacity();
+	}
+	return total;
+}
+
+void outboundQueue::clear(){
+	m_entries.clear();
+}
+
+ssize_t outboundQueue::sendPlain(int32_t socket, entry& e){
+	ssize_t ret = sendfile(socket, e.fd, &e.offset, e.remaining);
+	if (ret > 0){
+		return ret;
+	}
+	/* the file is shorter than when it was queued, waiting wouldn't give the missing bytes */
+	if (ret == 0){
+		errno = ENODATA;
+		return -1;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK){
+		return 0;
+	}
+	if (errno != EINVAL && errno != ENOSYS){
+		return -1;
+	}
+	e.copied = true;
+	return sendChunk(socket, NULL, e);
+}
+
+ssize_t outboundQueue::sendTls(SSL * ssl, entry& e){
+#ifndef OPENSSL_NO_KTLS
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl))){
+		ossl_ssize_t ret = SSL_sendfile(ssl, e.fd, e.offset, e.remaining, 0);
+		if (ret > 0){
+			e.offset += ret;
+			return ret;
+		}
+		if (ret == 0){
+			errno = ENODATA;
+			return -1;
+		}
+		int tmp = SSL_get_error(ssl, ret);
+		if (tmp == SSL_ERROR_WANT_WRITE || tmp == SSL_ERROR_WANT_READ){
+			return 0;
+		}
+		return -1;
+	}
+#endif
+	e.copied = true;
+	return sendChunk(-1, ssl, e);
+}
+
+ssize_t outboundQueue::sendChunk(int32_t socket, SSL * ssl, entry& e){
+	if (e.chunk.empty()){
+		size_t chunkSize = e.remaining < OUTBOUND_CHUNK_SIZE ? e.remaining : OUTBOUND_CHUNK_SIZE;
+		e.chunk.resize(chunkSize);
+		ssize_t length = pread(e.fd, &e.chunk[0], chunkSize, e.offset);
+		if (length <= 0){
+			e.chunk.clear();
+			if (length == 0){
+				errno = ENODATA;
+			}
+			return -1;
+		}
+		e.chunk.resize(length);
+		e.offset += length;
+	}
+	ssize_t ret;
+	if (ssl != NULL){
+		ret = SSL_write(ssl, e.chunk.data(), e.chunk.size());
+		if (ret <= 0){
+			int tmp = SSL_get_error(ssl, ret);
+			if (tmp == SSL_ERROR_WANT_WRITE || tmp == SSL_ERROR_WANT_READ){
+				return 0;
+			}
+			return -1;
+		}
+	}
+	else {
+		ret = send(socket, e.chunk.data(), e.chunk.size(), 0);
+		if (ret < 0){
+			if (errno == EAGAIN || errno == EWOULDBLOCK){
+				return 0;
+			}
+			return -1;
+		}
+	}
+	e.chunk.erase(0, ret);
+	return ret;
+}
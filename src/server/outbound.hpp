@@ -0,0 +1,82 @@
+#ifndef OUTBOUND_HPP
+#define OUTBOUND_HPP
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+#include <string>
+#include <list>
+
+#define OUTBOUND_CHUNK_SIZE 16384
+
+/* this class holds the data waiting to be sent on a socket, it is shared by the connection and client classes
+ * files and messages are queued in the same order as they were written, so a message never lands inside a file
+ * files are streamed without being copied in userspace buffers when possible :
+ * sendfile is used for plain sockets, SSL_sendfile for tls connections using kTLS
+ * otherwise the file is read by chunks of OUTBOUND_CHUNK_SIZE bytes (pread) and the chunk is written
+ */
+class outboundQueue
+{
+public:
+	outboundQueue();
+	~outboundQueue();
+	bool pushFile(int32_t fd, off_t offset, size_t len);
+	/* queues len bytes of file fd starting at offset (len 0 sends up to the end of the file)
+	 * fd is not owned by the queue and must stay open until the transfer is completed
+	 * returns false if these bytes aren't in the file, true otherwise
+	 */
+	void pushMessage(const char * buffer, size_t size);
+	/* queues a copy of size bytes of buffer
+	 */
+	int32_t progress(int32_t socket, SSL * ssl, int32_t * completedFd);
+	/* sends data of the first queued entry on socket (or through ssl if it is not NULL)
+	 * returns 1 when the entry is completed (the file descriptor, -1 for a message, is stored in completedFd),
+	 * 0 if the entry is not completed yet and -1 on error (errno is set, ENODATA if a file is shorter than queued)
+	 */
+	bool empty() const;
+	bool frontIsMessage() const;
+	/* returns true if the first queued entry is a message
+	 */
+	size_t pendingBytes() const;
+	/* returns the number of bytes waiting to be sent
+	 */
+	void clear();
+	/* drops every queued transfer
+	 */
+	size_t memoryUsage() const;
+	/* returns the heap memory used by the queue (files are not counted, they live in the page cache)
+	 */
+private:
+	struct entry
+	{
+		int32_t fd;
+		/* -1 for a message
+		 */
+		off_t offset;
+		/* offset in the file of the next byte to read
+		 */
+		size_t remaining;
+		/* bytes not sent yet, including the ones of chunk
+		 */
+		std::string chunk;
+		/* bytes read and not accepted by the socket yet (the whole message for a message)
+		 * an SSL_write which wants to be retried is retried with the same bytes
+		 */
+		bool copied;
+		/* the file can't be sent with sendfile, it is read by chunks
+		 */
+	};
+	ssize_t sendPlain(int32_t socket, entry& e);
+	ssize_t sendTls(SSL * ssl, entry& e);
+	ssize_t sendChunk(int32_t socket, SSL * ssl, entry& e);
+	std::list<entry> m_entries;
+};
+
+#endif /* OUTBOUND_HPP */
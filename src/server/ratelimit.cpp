@@ -0,0 +1,84 @@
+#include "ratelimit.hpp"
+
+using namespace std;
+
+rateState::rateState() : lastRefill(0){
+	for (uint8_t i = 0; i < RATE_LIMITS; i++){
+		tokens[i] = 0;
+	}
+}
+
+rateLimiter::rateLimiter(){
+	for (uint8_t i = 0; i < RATE_LIMITS; i++){
+		m_rate[i] = 0;
+		m_burst[i] = 0;
+	}
+}
+
+rateLimiter::~rateLimiter(){
+
+}
+
+void rateLimiter::setLimit(uint8_t limit, double rate, double burst){
+	if (limit >= RATE_LIMITS){
+		return;
+	}
+	m_rate[limit] = rate;
+	m_burst[limit] = (burst == 0) ? rate : burst;
+}
+
+bool rateLimiter::enabled() const{
+	for (uint8_t i = 0; i < RATE_LIMITS; i++){
+		if (m_rate[i] != 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+bool rateLimiter::allows(rateState& state, uint8_t limit, uint64_t timestamp) const{
+	if (m_rate[limit] == 0){
+		return true;
+	}
+	refill(state, timestamp);
+	return state.tokens[limit] > 0;
+}
+
+void rateLimiter::consume(rateState& state, uint8_t limit, double amount, uint64_t timestamp) const{
+	if (m_rate[limit] == 0){
+		return;
+	}
+	refill(state, timestamp);
+	state.tokens[limit] -= amount;
+}
+
+bool rateLimiter::idle(rateState& state, uint64_t timestamp) const{
+	refill(state, timestamp);
+	for (uint8_t i = 0; i < RATE_LIMITS; i++){
+		if (m_rate[i] != 0 && state.tokens[i] < m_burst[i]){
+			return false;
+		}
+	}
+	return true;
+}
+
+void rateLimiter::refill(rateState& state, uint64_t timestamp) const{
+	if (state.lastRefill == 0){
+		for (uint8_t i = 0; i < RATE_LIMITS; i++){
+			state.tokens[i] = m_burst[i];
+		}
+	}
+	else if (timestamp > state.lastRefill){
+		double elapsed = (double)(timestamp - state.lastRefill) / 1000000;
+		for (uint8_t i = 0; i < RATE_LIMITS; i++){
+			state.tokens[i] += elapsed * m_rate[i];
+			if (state.tokens[i] > m_burst[i]){
+				state.tokens[i] = m_burst[i];
+			}
+		}
+	}
+	else {
+		return;
+	}
+	state.lastRefill = timestamp;
+}
@@ -0,0 +1,57 @@
+#ifndef RATELIMIT_HPP
+#define RATELIMIT_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#define RATE_INBOUND_BYTES 0
+#define RATE_INBOUND_MESSAGES 1
+#define RATE_OUTBOUND_BYTES 2
+#define RATE_OUTBOUND_MESSAGES 3
+#define RATE_LIMITS 4
+
+/* token buckets of one connection (or of every connection sharing an id), one bucket per limit
+ * buckets are only refilled when they are accessed, so idle connections cost nothing
+ */
+class rateState
+{
+public:
+	rateState();
+	double tokens[RATE_LIMITS];
+	uint64_t lastRefill;
+	/* 0 until the buckets are accessed for the first time
+	 */
+};
+
+/* this class holds the configuration of the token buckets used by the server to limit connections
+ */
+class rateLimiter
+{
+public:
+	rateLimiter();
+	~rateLimiter();
+	void setLimit(uint8_t limit, double rate, double burst);
+	/* limit : RATE_INBOUND_BYTES, RATE_INBOUND_MESSAGES, RATE_OUTBOUND_BYTES or RATE_OUTBOUND_MESSAGES
+	 * rate : tokens added per second (0 removes the limit)
+	 * burst : maximum number of tokens in the bucket (rate if 0)
+	 */
+	bool enabled() const;
+	/* returns true if at least one limit is set
+	 */
+	bool allows(rateState& state, uint8_t limit, uint64_t timestamp) const;
+	/* returns true if the bucket of limit has tokens left (unlimited buckets always have)
+	 */
+	void consume(rateState& state, uint8_t limit, double amount, uint64_t timestamp) const;
+	/* removes amount tokens from the bucket of limit, the bucket can go in debt
+	 */
+	bool idle(rateState& state, uint64_t timestamp) const;
+	/* returns true if every bucket is full, the state can then be dropped
+	 */
+private:
+	void refill(rateState& state, uint64_t timestamp) const;
+	double m_rate[RATE_LIMITS];
+	double m_burst[RATE_LIMITS];
+};
+
+#endif /* RATELIMIT_HPP */
@@ -2,7 +2,7 @@
 
 using namespace std;
 
-server::server(uint16_t port, uint32_t maxConnections, bool tlsMode, bool blocking, uint32_t maxInactivityCounter, uint32_t maxConnectionCounter, const string& pathToKeyFile, const string& pathToCertFile) : m_tlsMode(tlsMode), m_blocking(blocking), m_port(port), m_mainSocket(-1), m_sslContext(NULL), m_pathToKeyFile(pathToKeyFile), m_pathToCertFile(pathToCertFile), m_maxConnections(maxConnections), m_maxInactivityCounter(maxInactivityCounter), m_maxConnectionCounter(maxConnectionCounter){
+server::server(uint16_t port, uint32_t maxConnections, bool tlsMode, bool blocking, uint32_t maxInactivityCounter, uint32_t maxConnectionCounter, const string& pathToKeyFile, const string& pathToCertFile) : m_tlsMode(tlsMode), m_blocking(blocking), m_lowMemory(false), m_multiplexing(false), m_port(port), m_transport(TRANSPORT_TCP4), m_dualStack(false), m_abstractNamespace(false), m_serverAddressLength(0), m_mainSocket(-1), m_sslContext(NULL), m_handoverSocket(-1), m_draining(false), m_sharedListener(false), m_balancer(NULL), m_worker(0), m_load(0), m_lastBalance(0), m_migrationCallback(NULL), m_migrationData(NULL), m_pathToKeyFile(pathToKeyFile), m_pathToCertFile(pathToCertFile), m_maxConnections(maxConnections), m_maxInactivityCounter(maxInactivityCounter), m_maxConnectionCounter(maxConnectionCounter), m_compressionPool(NULL), m_admission(NULL), m_rejectedConnections(0), m_trace(NULL), m_capture(NULL), m_capturedConnections(0), m_lastReadPass(0), m_lean(NULL){
 	if (tlsMode){
 		SSL_library_init();
 	}
@@ -12,6 +12,32 @@ server::server(uint16_t port, uint32_t maxConnections, bool tlsMode, bool blocki
 
 server::~server(){
 	shutdown();
+	if (m_compressionPool != NULL){
+		delete m_compressionPool;
+	}
+	if (m_admission != NULL){
+		delete m_admission;
+	}
+	disableTracing();
+	disableCapture();
+	if (m_lean != NULL){
+		delete m_lean;
+	}
+}
+
+void server::useIPv6(bool dualStack){
+	m_transport = TRANSPORT_TCP6;
+	m_dualStack = dualStack;
+}
+
+void server::useUnixSocket(const string& path, bool abstractNamespace){
+	m_transport = TRANSPORT_UNIX;
+	m_unixPath = path;
+	m_abstractNamespace = abstractNamespace;
+}
+
+uint8_t server::transport() const{
+	return m_transport;
 }
 
 bool server::launch(){
@@ -19,12 +45,57 @@ bool server::launch(){
 		if (m_mainSocket != -1){
 			throw serverError("server is already launched", ERROR_SERVER_LAUNCH);
 		}
-		m_serverAddress.sin_family = AF_INET;
-		m_serverAddress.sin_port = htons(m_port);
-		m_serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-		if ((m_mainSocket = socket(AF_INET, SOCK_STREAM, 0)) == -1){
+		if (m_lean != NULL && !leanCompatible()){
+			throw serverError("lean mode doesn't handle compression, multiplexing, admission control, rate limits nor load balancing", ERROR_SERVER_LAUNCH);
+		}
+		if (m_transport == TRANSPORT_UNIX){
+			struct sockaddr_un * address = (struct sockaddr_un *)&m_serverAddress;
+			if (m_unixPath.empty() || m_unixPath.size() + 1 > sizeof(address->sun_path)){
+				throw serverError("invalid unix socket path " + m_unixPath, ERROR_SERVER_LAUNCH);
+			}
+			address->sun_family = AF_UNIX;
+			if (m_abstractNamespace){
+				memcpy(address->sun_path + 1, m_unixPath.c_str(), m_unixPath.size());
+				m_serverAddressLength = offsetof(struct sockaddr_un, sun_path) + 1 + m_unixPath.size();
+			}
+			else {
+				memcpy(address->sun_path, m_unixPath.c_str(), m_unixPath.size() + 1);
+				m_serverAddressLength = sizeof(struct sockaddr_un);
+				if (!removeStaleSocket(m_unixPath)){
+					throw serverError(m_unixPath + " exists and isn't the socket of a stopped server", ERROR_SERVER_LAUNCH);
+				}
+			}
+		}
+		else if (m_transport == TRANSPORT_TCP6){
+			struct sockaddr_in6 * address = (struct sockaddr_in6 *)&m_serverAddress;
+			address->sin6_family = AF_INET6;
+			address->sin6_port = htons(m_port);
+			address->sin6_addr = in6addr_any;
+			m_serverAddressLength = sizeof(struct sockaddr_in6);
+		}
+		else {
+			struct sockaddr_in * address = (struct sockaddr_in *)&m_serverAddress;
+			address->sin_family = AF_INET;
+			address->sin_port = htons(m_port);
+			address->sin_addr.s_addr = htonl(INADDR_ANY);
+			m_serverAddressLength = sizeof(struct sockaddr_in);
+		}
+		if ((m_mainSocket = socket(m_serverAddress.ss_family, SOCK_STREAM, 0)) == -1){
 			throw serverError("can't create socket", ERROR_SERVER_LAUNCH);
 		}
+		if (m_transport != TRANSPORT_UNIX){
+			/* a restarted server can bind while the connections of the previous one are in TIME_WAIT */
+			int reuse = 1;
+			if (setsockopt(m_mainSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1){
+				throw serverError("can't set SO_REUSEADDR", ERROR_SERVER_LAUNCH);
+			}
+		}
+		if (m_transport == TRANSPORT_TCP6){
+			int v6only = m_dualStack ? 0 : 1;
+			if (setsockopt(m_mainSocket, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1){
+				throw serverError("can't set IPV6_V6ONLY", ERROR_SERVER_LAUNCH);
+			}
+		}
 		if (!m_blocking){
 			int options;
 			if ((options = fcntl(m_mainSocket, F_GETFL)) == -1){
@@ -34,26 +105,378 @@ bool server::launch(){
 				throw serverError("fcntl error", ERROR_SERVER_LAUNCH);
 			}
 		}
-		if (bind(m_mainSocket, (sockaddr *)&m_serverAddress, sizeof(sockaddr)) != 0){
+		if (bind(m_mainSocket, (sockaddr *)&m_serverAddress, m_serverAddressLength) != 0){
+			/* the socket file may have been created by another server meanwhile, shutdown mustn't remove it */
+			close(m_mainSocket);
+			m_mainSocket = -1;
 			throw serverError("can't bind socket", ERROR_SERVER_LAUNCH);
 		}
 		if (listen(m_mainSocket, 5) == -1){
 			throw serverError("can't call listen on socket", ERROR_SERVER_LAUNCH);
 		}
 		if (m_tlsMode){
-			if ((m_sslContext = SSL_CTX_new(TLS_server_method())) == NULL){
-				throw serverError("can't create a SSL_CTX", ERROR_SERVER_LAUNCH);
+			m_sslContext = createContext(m_pathToKeyFile, m_pathToCertFile);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+bool server::removeStaleSocket(const string& path){
+	struct stat status;
+	if (lstat(path.c_str(), &status) == -1){
+		return errno == ENOENT;
+	}
+	if (!S_ISSOCK(status.st_mode)){
+		errno = EEXIST;
+		return false;
+	}
+	/* the file of a server which has stopped without removing it refuses connections, a running server accepts them */
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	int32_t probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (probe == -1){
+		return false;
+	}
+	int32_t ret = ::connect(probe, (struct sockaddr *)&address, sizeof(address));
+	int32_t error = errno;
+	close(probe);
+	if (ret == 0 || error != ECONNREFUSED){
+		errno = EADDRINUSE;
+		return false;
+	}
+	return unlink(path.c_str()) == 0;
+}
+
+SSL_CTX * server::createContext(const string& pathToKeyFile, const string& pathToCertFile){
+	SSL_CTX * context;
+	if ((context = SSL_CTX_new(TLS_server_method())) == NULL){
+		throw serverError("can't create a SSL_CTX", ERROR_SERVER_LAUNCH);
+	}
+	try {
+		if (SSL_CTX_set_min_proto_version(context, TLS1_3_VERSION) == 0){
+			throw serverError("SSL_CTX_set_min_proto_version error", ERROR_SERVER_LAUNCH);
+		}
+		if (SSL_CTX_use_PrivateKey_file(context, pathToKeyFile.c_str(), SSL_FILETYPE_PEM) != 1){
+			throw serverError("SSL_CTX_use_PrivateKey_file error", ERROR_SERVER_LAUNCH);
+		}
+		if (SSL_CTX_use_certificate_file(context, pathToCertFile.c_str(), SSL_FILETYPE_PEM) != 1){
+			throw serverError("SSL_CTX_use_certificate_file error", ERROR_SERVER_LAUNCH);
+		}
+		if (SSL_CTX_check_private_key(context) != 1){
+			throw serverError("key doesn't match certificate", ERROR_SERVER_LAUNCH);
+		}
+	}
+	catch (const serverError&){
+		SSL_CTX_free(context);
+		throw;
+	}
+	SSL_CTX_set_verify(context, SSL_VERIFY_NONE, NULL);
+	/* a write which would block is retried from the outbound queue, where the message has been copied */
+	SSL_CTX_set_mode(context, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	if (m_lowMemory){
+		SSL_CTX_set_mode(context, SSL_MODE_RELEASE_BUFFERS);
+	}
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#endif
+	return context;
+}
+
+bool server::inheritListener(const string& path, int32_t timeout){
+	int32_t control = -1;
+	int options = -1;
+	try {
+		if (m_mainSocket != -1){
+			throw serverError("server is already launched", ERROR_SERVER_LAUNCH);
+		}
+		if (m_lean != NULL && !leanCompatible()){
+			throw serverError("lean mode doesn't handle compression, multiplexing, admission control, rate limits nor load balancing", ERROR_SERVER_LAUNCH);
+		}
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		if (path.empty() || path.size() + 1 > sizeof(address.sun_path)){
+			throw serverError("invalid handover socket path " + path, ERROR_SERVER_HANDOVER);
+		}
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		/* everything which can fail is done before the running server gives its socket away */
+		if (m_tlsMode){
+			m_sslContext = createContext(m_pathToKeyFile, m_pathToCertFile);
+		}
+		uint64_t deadline = admissionControl::now() + (uint64_t)timeout * 1000;
+		/* the running server may not have created its control socket yet */
+		while (true){
+			if ((control = socket(AF_UNIX, SOCK_STREAM, 0)) == -1){
+				throw serverError("can't create socket", ERROR_SERVER_HANDOVER);
 			}
-			if (SSL_CTX_set_min_proto_version(m_sslContext, TLS1_3_VERSION) == 0){
-				throw serverError("SSL_CTX_set_min_proto_version error", ERROR_SERVER_LAUNCH);
+			if (::connect(control, (struct sockaddr *)&address, sizeof(address)) == 0){
+				break;
 			}
-			if (SSL_CTX_use_PrivateKey_file(m_sslContext, m_pathToKeyFile.c_str(), SSL_FILETYPE_PEM) != 1){
-				throw serverError("SSL_CTX_use_PrivateKey_file error", ERROR_SERVER_LAUNCH);
+			close(control);
+			control = -1;
+			if ((errno != ENOENT && errno != ECONNREFUSED) || admissionControl::now() >= deadline){
+				throw serverError("can't connect to handover socket " + path, ERROR_SERVER_HANDOVER);
 			}
-			if (SSL_CTX_use_certificate_file(m_sslContext, m_pathToCertFile.c_str(), SSL_FILETYPE_PEM) != 1){
-				throw serverError("SSL_CTX_use_certificate_file error", ERROR_SERVER_LAUNCH);
+			usleep(10000);
+		}
+		struct pollfd pfd;
+		pfd.fd = control;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		uint64_t now = admissionControl::now();
+		if (poll(&pfd, 1, now < deadline ? (deadline - now) / 1000 : 0) <= 0){
+			throw serverError("no listening socket received", ERROR_SERVER_HANDOVER);
+		}
+		char magic[sizeof(HANDOVER_MAGIC)];
+		struct iovec iov;
+		iov.iov_base = magic;
+		iov.iov_len = sizeof(magic);
+		union {
+			struct cmsghdr header;
+			char buffer[CMSG_SPACE(sizeof(int32_t))];
+		} control_message;
+		struct msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control_message.buffer;
+		message.msg_controllen = sizeof(control_message.buffer);
+		if (recvmsg(control, &message, MSG_CMSG_CLOEXEC) != sizeof(magic) || memcmp(magic, HANDOVER_MAGIC, sizeof(magic)) != 0){
+			throw serverError("invalid handover message", ERROR_SERVER_HANDOVER);
+		}
+		struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+		if (header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int32_t))){
+			throw serverError("no listening socket received", ERROR_SERVER_HANDOVER);
+		}
+		memcpy(&m_mainSocket, CMSG_DATA(header), sizeof(int32_t));
+		m_serverAddressLength = sizeof(m_serverAddress);
+		if (getsockname(m_mainSocket, (struct sockaddr *)&m_serverAddress, &m_serverAddressLength) != 0){
+			throw serverError("can't get address of the inherited socket", ERROR_SERVER_HANDOVER);
+		}
+		if (m_serverAddress.ss_family == AF_UNIX){
+			struct sockaddr_un * unixAddress = (struct sockaddr_un *)&m_serverAddress;
+			m_transport = TRANSPORT_UNIX;
+			m_abstractNamespace = unixAddress->sun_path[0] == '\0';
+			m_unixPath = m_abstractNamespace ? string(unixAddress->sun_path + 1, m_serverAddressLength - offsetof(struct sockaddr_un, sun_path) - 1) : string(unixAddress->sun_path);
+		}
+		else if (m_serverAddress.ss_family == AF_INET6){
+			m_transport = TRANSPORT_TCP6;
+			m_port = ntohs(((struct sockaddr_in6 *)&m_serverAddress)->sin6_port);
+		}
+		else {
+			m_transport = TRANSPORT_TCP4;
+			m_port = ntohs(((struct sockaddr_in *)&m_serverAddress)->sin_port);
+		}
+		/* the flags of the socket are shared with the previous server, they are restored if it keeps the socket */
+		if ((options = fcntl(m_mainSocket, F_GETFL)) == -1){
+			throw serverError("fcntl error", ERROR_SERVER_HANDOVER);
+		}
+		if (fcntl(m_mainSocket, F_SETFL, m_blocking ? options & ~O_NONBLOCK : options | O_NONBLOCK) == -1){
+			options = -1;
+			throw serverError("fcntl error", ERROR_SERVER_HANDOVER);
+		}
+		/* the running server only stops accepting once it gets this acknowledgement */
+		if (send(control, HANDOVER_MAGIC, sizeof(HANDOVER_MAGIC), MSG_NOSIGNAL) != sizeof(HANDOVER_MAGIC)){
+			throw serverError("can't acknowledge the listening socket", ERROR_SERVER_HANDOVER);
+		}
+		close(control);
+		control = -1;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		if (control != -1){
+			close(control);
+		}
+		/* the socket still belongs to the running server, its file must not be removed by shutdown */
+		if (m_mainSocket != -1){
+			if (options != -1){
+				fcntl(m_mainSocket, F_SETFL, options);
 			}
-			SSL_CTX_set_verify(m_sslContext, SSL_VERIFY_NONE, NULL);
+			close(m_mainSocket);
+			m_mainSocket = -1;
+		}
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+bool server::enableHandover(const string& path){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to enable handover on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		if (path.empty() || path.size() + 1 > sizeof(address.sun_path)){
+			throw serverError("invalid handover socket path " + path, ERROR_SERVER_HANDOVER);
+		}
+		closeHandover();
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		if (!removeStaleSocket(path)){
+			throw serverError(path + " exists and isn't the socket of a stopped server", ERROR_SERVER_HANDOVER);
+		}
+		if ((m_handoverSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1){
+			throw serverError("can't create socket", ERROR_SERVER_HANDOVER);
+		}
+		if (bind(m_handoverSocket, (struct sockaddr *)&address, sizeof(address)) != 0){
+			close(m_handoverSocket);
+			m_handoverSocket = -1;
+			throw serverError("can't bind handover socket " + path, ERROR_SERVER_HANDOVER);
+		}
+		m_handoverPath = path;
+		/* only processes of the same user can take the socket, connections are refused until listen is called */
+		if (chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0){
+			throw serverError("can't restrict the permissions of " + path, ERROR_SERVER_HANDOVER);
+		}
+		if (listen(m_handoverSocket, 1) == -1){
+			throw serverError("can't call listen on handover socket", ERROR_SERVER_HANDOVER);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		closeHandover();
+		return false;
+	}
+	return true;
+}
+
+bool server::handover(){
+	if (m_handoverSocket == -1 || m_draining){
+		return false;
+	}
+	int32_t control = ::accept4(m_handoverSocket, NULL, NULL, SOCK_CLOEXEC);
+	if (control == -1){
+		return false;
+	}
+	try {
+		struct ucred credentials;
+		socklen_t length = sizeof(credentials);
+		if (getsockopt(control, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 || credentials.uid != geteuid()){
+			throw serverError("handover refused to a process of another user", ERROR_SERVER_HANDOVER);
+		}
+		/* the path is free before the new server gets the socket, so it can offer the next handover at the same path */
+		string path = m_handoverPath;
+		closeHandover();
+		char magic[sizeof(HANDOVER_MAGIC)];
+		memcpy(magic, HANDOVER_MAGIC, sizeof(magic));
+		struct iovec iov;
+		iov.iov_base = magic;
+		iov.iov_len = sizeof(magic);
+		union {
+			struct cmsghdr header;
+			char buffer[CMSG_SPACE(sizeof(int32_t))];
+		} control_message;
+		memset(&control_message, 0, sizeof(control_message));
+		struct msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control_message.buffer;
+		message.msg_controllen = sizeof(control_message.buffer);
+		struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(sizeof(int32_t));
+		memcpy(CMSG_DATA(header), &m_mainSocket, sizeof(int32_t));
+		bool acknowledged = sendmsg(control, &message, MSG_NOSIGNAL) == sizeof(magic);
+		/* the new server acknowledges once it is ready to accept, until then this server keeps accepting */
+		struct pollfd pfd;
+		pfd.fd = control;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		acknowledged = acknowledged && poll(&pfd, 1, HANDOVER_ACK_TIMEOUT) == 1;
+		acknowledged = acknowledged && recv(control, magic, sizeof(magic), MSG_DONTWAIT) == sizeof(magic) && memcmp(magic, HANDOVER_MAGIC, sizeof(magic)) == 0;
+		if (!acknowledged){
+			/* a later attempt can be made at the same path */
+			enableHandover(path);
+			throw serverError("the listening socket hasn't been taken over", ERROR_SERVER_HANDOVER);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		close(control);
+		return false;
+	}
+	close(control);
+	/* the listening socket stays open (the new server accepts from it) but this server doesn't accept anymore */
+	m_draining = true;
+	return true;
+}
+
+bool server::draining() const{
+	return m_draining;
+}
+
+uint32_t server::drainConnections(uint32_t count){
+	if (m_lean != NULL){
+		return m_draining ? m_lean->drainConnections(count) : m_lean->connectedConnections();
+	}
+	if (m_draining){
+		for (uint32_t i = 0; i < count && !m_connections.empty(); i++){
+			kickConnection(m_connections.front());
+			m_connections.pop_front();
+		}
+	}
+	return m_connections.size();
+}
+
+bool server::reloadCertificate(const string& pathToKeyFile, const string& pathToCertFile){
+	try {
+		if (!m_tlsMode){
+			throw serverError("trying to reload the certificate of a non-tls server", ERROR_SERVER_NOT_TLS);
+		}
+		if (m_mainSocket == -1){
+			throw serverError("trying to reload the certificate of an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		string key = pathToKeyFile.empty() ? m_pathToKeyFile : pathToKeyFile;
+		string cert = pathToCertFile.empty() ? m_pathToCertFile : pathToCertFile;
+		SSL_CTX * context = createContext(key, cert);
+		/* connections hold a reference on the context they were created with, freeing the old one is safe */
+		SSL_CTX_free(m_sslContext);
+		m_sslContext = context;
+		m_pathToKeyFile = key;
+		m_pathToCertFile = cert;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+		return false;
+	}
+	return true;
+}
+
+bool server::shareListener(const server& listener){
+	try {
+		if (m_mainSocket != -1){
+			throw serverError("server is already launched", ERROR_SERVER_LAUNCH);
+		}
+		if (m_lean != NULL && !leanCompatible()){
+			throw serverError("lean mode doesn't handle compression, multiplexing, admission control, rate limits nor load balancing", ERROR_SERVER_LAUNCH);
+		}
+		if (listener.m_mainSocket == -1){
+			throw serverError("trying to share the listening socket of an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		if ((m_mainSocket = fcntl(listener.m_mainSocket, F_DUPFD_CLOEXEC, 0)) == -1){
+			throw serverError("can't duplicate the listening socket", ERROR_SERVER_LAUNCH);
+		}
+		m_sharedListener = true;
+		m_transport = listener.m_transport;
+		m_port = listener.m_port;
+		m_dualStack = listener.m_dualStack;
+		m_abstractNamespace = listener.m_abstractNamespace;
+		m_unixPath = listener.m_unixPath;
+		m_serverAddress = listener.m_serverAddress;
+		m_serverAddressLength = listener.m_serverAddressLength;
+		if (m_tlsMode){
+			m_sslContext = createContext(m_pathToKeyFile, m_pathToCertFile);
 		}
 	}
 	catch (const serverError& error){
@@ -64,41 +487,398 @@ bool server::launch(){
 	return true;
 }
 
+void server::setLoadBalancer(loadBalancer * balancer, uint32_t worker){
+	m_balancer = balancer;
+	m_worker = worker;
+	m_lastBalance = 0;
+	if (m_balancer != NULL){
+		m_balancer->report(m_worker, m_load, m_connections.size());
+	}
+}
+
+void server::balanceConnections(){
+	if (m_balancer == NULL){
+		return;
+	}
+	vector<connection *> moved;
+	if (m_balancer->collect(m_worker, moved)){
+		for (size_t i = 0; i < moved.size(); i++){
+			moved[i]->offerCompression(m_compressionPool);
+			moved[i]->offerMultiplexing(m_multiplexing);
+			/* released by the previous server, its source is counted here until it is kicked */
+			if (m_admission != NULL){
+				m_admission->adopt(moved[i]->getAddress());
+			}
+			m_connections.push_back(moved[i]);
+		}
+		m_balancer->report(m_worker, m_load, m_connections.size());
+	}
+	uint64_t now = admissionControl::now();
+	if (m_lastBalance == 0){
+		m_lastBalance = now;
+		return;
+	}
+	if (now - m_lastBalance < LOAD_WINDOW){
+		return;
+	}
+	uint64_t elapsed = now - m_lastBalance;
+	m_lastBalance = now;
+	m_load = 0;
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		connectionLoad * load = (*i)->load();
+		uint64_t cost = (load->callbackTime + (uint64_t)load->messages * LOAD_MESSAGE_COST + load->bytes / LOAD_BYTE_COST) * LOAD_WINDOW / elapsed;
+		load->cost = (load->cost + cost) / 2;
+		load->bytes = 0;
+		load->messages = 0;
+		load->callbackTime = 0;
+		m_load += load->cost;
+	}
+	m_balancer->report(m_worker, m_load, m_connections.size());
+	uint64_t difference = 0;
+	int32_t target = m_balancer->migrationTarget(m_worker, &difference);
+	if (target < 0){
+		return;
+	}
+	/* at most half of the difference is moved, so the two workers don't swap their roles */
+	uint64_t budget = difference / 2;
+	auto candidate = m_connections.end();
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		uint64_t cost = (*i)->load()->cost;
+		if (cost <= budget && movable(*i) && (candidate == m_connections.end() || cost > (*candidate)->load()->cost)){
+			candidate = i;
+		}
+	}
+	if (candidate == m_connections.end()){
+		return;
+	}
+	connection * c = *candidate;
+	m_connections.erase(candidate);
+	/* its number is closed here, the capture of its new server records it as a new connection */
+	if (m_capture != NULL && m_captured.count(c) != 0){
+		capture(c, CAPTURE_KICK, 0, NULL, 0);
+	}
+	if (m_admission != NULL){
+		m_admission->release(c->getAddress());
+	}
+	m_load -= c->load()->cost;
+	m_balancer->report(m_worker, m_load, m_connections.size());
+	int64_t id = c->getConnectionId();
+	m_balancer->post(target, c);
+	if (m_migrationCallback != NULL){
+		m_migrationCallback(id, target, m_migrationData);
+	}
+}
+
+void server::setMigrationCallback(void callback(int64_t, uint32_t, void *), void * data){
+	m_migrationCallback = callback;
+	m_migrationData = data;
+}
+
+uint64_t server::load() const{
+	return m_load;
+}
+
+bool server::movable(connection * c) const{
+	if (c->getSocket() == -1 || c->isCompressed()){
+		return false;
+	}
+	return !c->isTls() || c->ishandshakeMade();
+}
+
+void server::closeHandover(){
+	if (m_handoverSocket != -1){
+		close(m_handoverSocket);
+		m_handoverSocket = -1;
+		unlink(m_handoverPath.c_str());
+	}
+}
+
 void server::shutdown(){
+	if (m_lean != NULL){
+		m_lean->kickConnections();
+	}
 	for (auto i=m_connections.begin(); i!=m_connections.end(); i++){
 		kickConnection(*i);
-		m_connections.erase(i);
 	}
+	m_connections.clear();
+	closeHandover();
 	if (m_mainSocket != -1){
 		close(m_mainSocket);
 		m_mainSocket = -1;
+		/* after a handover the socket file belongs to the new server */
+		if (m_transport == TRANSPORT_UNIX && !m_abstractNamespace && !m_draining && !m_sharedListener){
+			unlink(m_unixPath.c_str());
+		}
 	}
+	m_draining = false;
+	m_sharedListener = false;
 	if (m_sslContext != NULL){
 		SSL_CTX_free(m_sslContext);
 		m_sslContext = NULL;
 	}
 	memset(&m_serverAddress, 0, sizeof(m_serverAddress));
+	m_serverAddressLength = 0;
 	return;
 }
 
+bool server::enableCompression(const string& pathToDictionary, int32_t level, uint32_t threshold){
+	try {
+		if (!compressionPool::available()){
+			throw serverError("library built without zstd support", ERROR_SERVER_COMPRESSION);
+		}
+		compressionPool * pool = new compressionPool(level, threshold);
+		if (!pool->loadDictionary(pathToDictionary)){
+			delete pool;
+			throw serverError("can't load dictionary " + pathToDictionary, ERROR_SERVER_COMPRESSION);
+		}
+		for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+			if ((*i)->isCompressed()){
+				delete pool;
+				throw serverError("can't change dictionary while connections use it", ERROR_SERVER_COMPRESSION);
+			}
+		}
+		for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+			(*i)->offerCompression(pool);
+		}
+		if (m_compressionPool != NULL){
+			delete m_compressionPool;
+		}
+		m_compressionPool = pool;
+		return true;
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+	return false;
+}
+
+void server::enableMultiplexing(){
+	m_multiplexing = true;
+}
+
+void server::setLowMemoryMode(bool lowMemory){
+	m_lowMemory = lowMemory;
+}
+
+void server::setLeanMode(bool lean){
+	if (m_mainSocket != -1){
+		return;
+	}
+	if (m_lean != NULL){
+		delete m_lean;
+		m_lean = NULL;
+	}
+	if (lean){
+		m_lean = specializedServer::create(m_tlsMode, m_blocking, m_maxConnections, m_maxInactivityCounter, m_maxConnectionCounter);
+	}
+}
+
+bool server::leanCompatible() const{
+	return m_compressionPool == NULL && !m_multiplexing && m_admission == NULL && !m_connectionLimits.enabled() && !m_idLimits.enabled() && m_balancer == NULL;
+}
+
+size_t server::memoryUsage() const{
+	/* list and map nodes hold two or four pointers of bookkeeping besides their value */
+	size_t total = sizeof(server);
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		total += (*i)->memoryUsage() + sizeof(connection *) + 2 * sizeof(void *);
+	}
+	total += m_idRates.size() * (sizeof(pair<int64_t, rateState>) + 4 * sizeof(void *));
+	if (m_compressionPool != NULL){
+		total += m_compressionPool->memoryUsage();
+	}
+	if (m_admission != NULL){
+		total += m_admission->memoryUsage();
+	}
+	if (m_lean != NULL){
+		total += m_lean->memoryUsage();
+	}
+	return total;
+}
+
+void server::memoryUsagePerConnection(void callback(int64_t, size_t, void *), void * data) const{
+	if (m_lean != NULL){
+		m_lean->memoryUsagePerConnection(callback, data);
+		return;
+	}
+	for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+		callback((*i)->getConnectionId(), (*i)->memoryUsage(), data);
+	}
+}
+
+void server::enableTracing(uint32_t capacity, uint32_t sampleInterval){
+	disableTracing();
+	m_trace = new traceRing(capacity, sampleInterval);
+	m_lastReadPass = 0;
+}
+
+void server::disableTracing(){
+	if (m_trace != NULL){
+		delete m_trace;
+		m_trace = NULL;
+	}
+}
+
+bool server::dumpTrace(const string& path) const{
+	if (m_trace == NULL){
+		return false;
+	}
+	return m_trace->dump(path);
+}
+
+bool server::enableCapture(const string& path, uint64_t capacity){
+	disableCapture();
+	m_capture = new captureLog();
+	if (!m_capture->open(path, capacity, admissionControl::now())){
+		delete m_capture;
+		m_capture = NULL;
+		try {
+			throw serverError("can't create capture file " + path, ERROR_SERVER_LAUNCH);
+		}
+		catch (const serverError& error){
+			error.outputMessage();
+		}
+		return false;
+	}
+	return true;
+}
+
+void server::disableCapture(){
+	if (m_capture != NULL){
+		delete m_capture;
+		m_capture = NULL;
+	}
+	m_captured.clear();
+}
+
+uint64_t server::droppedCaptureRecords() const{
+	if (m_capture == NULL){
+		return 0;
+	}
+	return m_capture->dropped();
+}
+
+void server::capture(connection * c, uint16_t type, uint32_t stream, const char * message, size_t size){
+	uint64_t now = admissionControl::now();
+	auto i = m_captured.find(c);
+	if (i == m_captured.end()){
+		i = m_captured.insert(make_pair(c, m_capturedConnections++)).first;
+		if (type != CAPTURE_ACCEPT){
+			m_capture->append(now, i->second, 0, CAPTURE_ACCEPT, NULL, 0);
+		}
+	}
+	m_capture->append(now, i->second, stream, type, message, size);
+	if (type == CAPTURE_KICK){
+		m_captured.erase(i);
+	}
+}
+
 uint32_t server::maxConnections() const{
 	return m_maxConnections;
 }
 uint32_t server::connectedConnections() const{
+	if (m_lean != NULL){
+		return m_lean->connectedConnections();
+	}
 	return m_connections.size();
 }
 
+void server::setAdmissionControl(uint32_t maxConnectionsPerSource, uint32_t acceptRate, uint32_t acceptBurst, uint32_t maxLoopLag, bool resetOnReject){
+	if (m_admission != NULL){
+		delete m_admission;
+	}
+	m_admission = new admissionControl(maxConnectionsPerSource, acceptRate, acceptBurst, maxLoopLag, resetOnReject);
+}
+
+uint64_t server::rejectedConnections() const{
+	return m_rejectedConnections;
+}
+
+uint32_t server::loopLag() const{
+	if (m_admission == NULL){
+		return 0;
+	}
+	return m_admission->loopLag();
+}
+
+void server::setRateLimit(uint8_t limit, double rate, double burst, bool perConnectionId){
+	if (perConnectionId){
+		m_idLimits.setLimit(limit, rate, burst);
+	}
+	else {
+		m_connectionLimits.setLimit(limit, rate, burst);
+	}
+}
+
+bool server::throttled(connection * c, uint8_t bytesLimit, uint8_t messagesLimit, uint64_t now){
+	/* buckets are only allocated by consume, connections and ids without buckets have them full */
+	if (m_connectionLimits.enabled()){
+		rateState * state = c->rates(false);
+		if (state != NULL && (!m_connectionLimits.allows(*state, bytesLimit, now) || !m_connectionLimits.allows(*state, messagesLimit, now))){
+			return true;
+		}
+	}
+	if (m_idLimits.enabled() && c->getConnectionId() >= 0){
+		auto state = m_idRates.find(c->getConnectionId());
+		if (state != m_idRates.end() && (!m_idLimits.allows(state->second, bytesLimit, now) || !m_idLimits.allows(state->second, messagesLimit, now))){
+			return true;
+		}
+	}
+	return false;
+}
+
+void server::consume(connection * c, uint8_t bytesLimit, uint8_t messagesLimit, size_t bytes, size_t messages, uint64_t now){
+	if (m_connectionLimits.enabled()){
+		rateState * state = c->rates();
+		m_connectionLimits.consume(*state, bytesLimit, bytes, now);
+		m_connectionLimits.consume(*state, messagesLimit, messages, now);
+	}
+	if (m_idLimits.enabled() && c->getConnectionId() >= 0){
+		rateState& state = m_idRates[c->getConnectionId()];
+		m_idLimits.consume(state, bytesLimit, bytes, now);
+		m_idLimits.consume(state, messagesLimit, messages, now);
+	}
+}
+
 bool server::acceptConnection(){
 	try {
 		if (m_mainSocket == -1){
 			throw serverError("trying to accept client on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
 		}
-		if (m_maxConnections <= m_connections.size()){
-			throw serverError("server is full can't accept client (" + to_string(m_connections.size()) + "/" + to_string(m_maxConnections) + ")", ERROR_SERVER_FULL);
+		if (m_draining || (m_balancer != NULL && m_balancer->leastLoaded() != m_worker)){
+			return false;
+		}
+		if (m_lean != NULL){
+			return m_lean->acceptConnection(m_mainSocket, m_sslContext);
+		}
+		uint64_t now = 0;
+		if (m_admission != NULL){
+			now = admissionControl::now();
+			m_admission->loopTick();
+		}
+		if (m_maxConnections <= m_connections.size() || (m_admission != NULL && m_admission->overloaded())){
+			rejectConnection();
+			return false;
 		}
-		connection * tmpConnection = new connection(m_tlsMode, m_blocking);
+		connection * tmpConnection = new connection(m_tlsMode, m_blocking, m_lowMemory);
+		tmpConnection->offerCompression(m_compressionPool);
+		tmpConnection->offerMultiplexing(m_multiplexing);
 		if (tmpConnection->accept(m_mainSocket, m_sslContext) == true){
+			if (m_admission != NULL && !m_admission->admit(tmpConnection->getAddress(), now)){
+				tmpConnection->disconnect(m_admission->resetOnReject());
+				delete tmpConnection;
+				m_rejectedConnections++;
+				return false;
+			}
+			TLS_TRACE1(accept, tmpConnection->getSocket());
 			m_connections.push_back(tmpConnection);
+			if (m_capture != NULL){
+				capture(tmpConnection, CAPTURE_ACCEPT, 0, NULL, 0);
+			}
+			if (m_balancer != NULL){
+				/* published at once, so the next connection goes to another worker */
+				m_balancer->report(m_worker, m_load, m_connections.size());
+			}
 		}
 		else {
 			delete tmpConnection;
@@ -112,6 +892,21 @@ bool server::acceptConnection(){
 	return false;
 }
 
+void server::rejectConnection(){
+	int32_t socket = ::accept(m_mainSocket, NULL, NULL);
+	if (socket == -1){
+		return;
+	}
+	if (m_admission != NULL && m_admission->resetOnReject()){
+		struct linger l;
+		l.l_onoff = 1;
+		l.l_linger = 0;
+		setsockopt(socket, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	}
+	close(socket);
+	m_rejectedConnections++;
+}
+
 void server::handshakeConnections(){
 	try {
 		if (m_mainSocket == -1){
@@ -120,11 +915,19 @@ void server::handshakeConnections(){
 		if (!m_tlsMode){
 			throw serverError("trying to handshake on an non-tls server", ERROR_SERVER_NOT_TLS);
 		}
+		if (m_lean != NULL){
+			m_lean->handshakeConnections();
+			return;
+		}
+		uint64_t start = m_admission != NULL ? admissionControl::now() : 0;
 		for (auto i = m_connections.begin(); i != m_connections.end(); i++){
 			if (!(*i)->ishandshakeMade() && (*i)->isTls()){
 				(*i)->doHandshake();
 			}
 		}
+		if (m_admission != NULL){
+			m_admission->busy(admissionControl::now() - start);
+		}
 	}
 	catch (const serverError& error){
 		error.outputMessage();
@@ -132,6 +935,13 @@ void server::handshakeConnections(){
 }
 
 void server::kickConnection(connection * c){
+	TLS_TRACE2(kick, c->getConnectionId(), c->getSocket());
+	if (m_capture != NULL){
+		capture(c, CAPTURE_KICK, 0, NULL, 0);
+	}
+	if (m_admission != NULL){
+		m_admission->release(c->getAddress());
+	}
 	delete c;
 }
 
@@ -140,6 +950,10 @@ void server::cleanupConnections(){
 		if (m_mainSocket == -1){
 			throw serverError("trying to cleanup clients on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
 		}
+		if (m_lean != NULL){
+			m_lean->cleanupConnections();
+			return;
+		}
 		for (auto i = m_connections.begin(); i != m_connections.end();){
 			auto j=i;
 			j++;
@@ -149,6 +963,17 @@ void server::cleanupConnections(){
 			}
 			i=j;
 		}
+		if (!m_idRates.empty()){
+			uint64_t now = admissionControl::now();
+			for (auto i = m_idRates.begin(); i != m_idRates.end();){
+				if (m_idLimits.idle(i->second, now)){
+					i = m_idRates.erase(i);
+				}
+				else {
+					i++;
+				}
+			}
+		}
 	}
 	catch (const serverError& error){
 		error.outputMessage();
@@ -156,56 +981,218 @@ void server::cleanupConnections(){
 }
 
 void server::readFromConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), void * data){
+	readConnections(callback, NULL, data);
+}
+
+void server::readFromStreams(int64_t callback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data){
+	readConnections(NULL, callback, data);
+}
+
+void server::readConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), int64_t streamCallback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data){
 	try {
 		if (m_mainSocket == -1){
 			throw serverError("trying to read from clients on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
 		}
-		char * buffer = (char*) malloc(sizeof(char) * MAX_BUFFER_SIZE);
+		if (m_lean != NULL){
+			if (callback != NULL){
+				m_lean->readFromConnections(callback, data);
+			}
+			else {
+				m_lean->readFromStreams(streamCallback, data);
+			}
+			return;
+		}
+		bool limited = m_connectionLimits.enabled() || m_idLimits.enabled();
+		uint64_t now = (limited || m_trace != NULL) ? admissionControl::now() : 0;
+		uint32_t loopDelay = 0;
+		if (m_trace != NULL){
+			loopDelay = m_lastReadPass != 0 ? now - m_lastReadPass : 0;
+			m_lastReadPass = now;
+		}
+		uint64_t start = m_admission != NULL ? admissionControl::now() : 0;
+		char buffer[MAX_BUFFER_SIZE];
 		for (auto i = m_connections.begin(); i != m_connections.end();){
 			auto j = i;
 			j++;
-			memset(buffer, 0, sizeof(char) * MAX_BUFFER_SIZE);
-			if ((*i)->readFromConnection(buffer)){
-				if (callback != NULL){
-					bool response = false;
-					int tmp = callback((*i)->getConnectionId(), buffer, data, &response);
-					if (tmp > 0){
-						(*i)->identifyConnection(tmp);
-					}
-					else if (tmp == -1){
-						kickConnection(*i);
-						m_connections.erase(i);
-					}
-					if (tmp >= 0 && response){
-						(*i)->writeToConnection(buffer);
-					}
+			if (limited && throttled(*i, RATE_INBOUND_BYTES, RATE_INBOUND_MESSAGES, now)){
+				i=j;
+				continue;
+			}
+			/* messages waiting in the outbound queue are sent before the next responses */
+			if ((*i)->hasPendingOutput() && !(*i)->flushMessages()){
+				kickConnection(*i);
+				m_connections.erase(i);
+				i=j;
+				continue;
+			}
+			memset(buffer, 0, sizeof(buffer));
+			size_t size = 0;
+			traceRecord record;
+			if (m_trace != NULL){
+				record.timestamp = admissionControl::now();
+				record.loopDelay = loopDelay;
+			}
+			if (!(*i)->readFromConnection(buffer, &size)){
+				kickConnection(*i);
+				m_connections.erase(i);
+				i=j;
+				continue;
+			}
+			if (m_trace != NULL){
+				record.readTime = admissionControl::now() - record.timestamp;
+			}
+			bool kicked = false;
+			if (!(*i)->isMultiplexed()){
+				kicked = !handleMessage(*i, 0, buffer, size, callback, streamCallback, data, now, m_trace != NULL ? &record : NULL);
+			}
+			else {
+				/* every complete message is handled like a message of a simple connection, responses are sent on its stream */
+				uint32_t stream;
+				while (!kicked && (*i)->nextStreamMessage(&stream, buffer, &size)){
+					kicked = !handleMessage(*i, stream, buffer, size, callback, streamCallback, data, now, m_trace != NULL ? &record : NULL);
+				}
+				if (!kicked && !(*i)->flushStreams()){
+					kicked = true;
 				}
 			}
-			else{
+			if (kicked){
 				kickConnection(*i);
 				m_connections.erase(i);
 			}
 			i=j;
 		}
-		free(buffer);
+		if (m_admission != NULL){
+			m_admission->busy(admissionControl::now() - start);
+		}
 	}
 	catch (const serverError& error){
 		error.outputMessage();
 	}
 }
 
+bool server::handleMessage(connection * c, uint32_t stream, char * buffer, size_t size, int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), int64_t streamCallback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data, uint64_t now, traceRecord * record){
+	bool limited = m_connectionLimits.enabled() || m_idLimits.enabled();
+	if (limited && size > 0){
+		consume(c, RATE_INBOUND_BYTES, RATE_INBOUND_MESSAGES, size, 1, now);
+	}
+	bool traced = record != NULL && size > 0 && m_trace->sample();
+	if (traced){
+		record->id = c->getConnectionId();
+		record->size = size;
+		record->flags = 0;
+		record->callbackTime = 0;
+		record->writeTime = 0;
+	}
+	if (callback == NULL && streamCallback == NULL){
+		if (traced){
+			m_trace->push(*record);
+		}
+		return true;
+	}
+	if (m_capture != NULL && size > 0){
+		capture(c, CAPTURE_READ, stream, buffer, size);
+	}
+	bool balanced = m_balancer != NULL && size > 0;
+	if (balanced){
+		c->load()->bytes += size;
+		c->load()->messages++;
+	}
+	bool response = false;
+	TLS_TRACE1(callback_enter, c->getConnectionId());
+	uint64_t callbackStart = traced || balanced ? admissionControl::now() : 0;
+	int64_t tmp;
+	size_t responseSize;
+	if (streamCallback != NULL){
+		responseSize = size;
+		tmp = streamCallback(c->getConnectionId(), stream, buffer, &responseSize, data, &response);
+		if (responseSize > MAX_BUFFER_SIZE){
+			responseSize = MAX_BUFFER_SIZE;
+		}
+	}
+	else {
+		tmp = callback(c->getConnectionId(), buffer, data, &response);
+		responseSize = strnlen(buffer, MAX_BUFFER_SIZE);
+	}
+	if (traced || balanced){
+		uint64_t callbackTime = admissionControl::now() - callbackStart;
+		if (traced){
+			record->callbackTime = callbackTime;
+		}
+		if (balanced){
+			c->load()->callbackTime += callbackTime;
+		}
+	}
+	TLS_TRACE2(callback_exit, c->getConnectionId(), tmp);
+	if (tmp > 0){
+		c->identifyConnection(tmp);
+	}
+	else if (tmp == -1){
+		if (traced){
+			m_trace->push(*record);
+		}
+		return false;
+	}
+	if (response && responseSize > 0){
+		if (limited){
+			consume(c, RATE_OUTBOUND_BYTES, RATE_OUTBOUND_MESSAGES, responseSize, 1, now);
+		}
+		if (balanced){
+			c->load()->bytes += responseSize;
+		}
+		if (m_capture != NULL){
+			capture(c, CAPTURE_WRITE, stream, buffer, responseSize);
+		}
+		uint64_t writeStart = traced ? admissionControl::now() : 0;
+		/* a response which can't be written leaves the connection unusable */
+		bool written = c->isMultiplexed() ? c->writeToStream(stream, buffer, responseSize) : c->writeToConnection(buffer, responseSize);
+		if (traced){
+			record->writeTime = admissionControl::now() - writeStart;
+			record->flags |= TRACE_RESPONSE;
+		}
+		if (!written){
+			if (traced){
+				m_trace->push(*record);
+			}
+			return false;
+		}
+	}
+	if (traced){
+		m_trace->push(*record);
+	}
+	return true;
+}
+
 void server::writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data){
 	try {
 		if (m_mainSocket == -1){
 			throw serverError("trying to write to clients on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
 		}
-		char * buffer = (char*) malloc(sizeof(char) * MAX_BUFFER_SIZE);
+		if (m_lean != NULL){
+			if (callback != NULL){
+				m_lean->writeToConnections(callback, data);
+			}
+			return;
+		}
+		bool limited = m_connectionLimits.enabled() || m_idLimits.enabled();
+		uint64_t now = limited ? admissionControl::now() : 0;
+		uint64_t start = m_admission != NULL ? admissionControl::now() : 0;
+		char buffer[MAX_BUFFER_SIZE];
 		for (auto i = m_connections.begin(); i != m_connections.end();){
 			auto j = i;
 			j++;
-			memset(buffer, 0, sizeof(char) * MAX_BUFFER_SIZE);
+			if (limited && throttled(*i, RATE_OUTBOUND_BYTES, RATE_OUTBOUND_MESSAGES, now)){
+				i=j;
+				continue;
+			}
+			memset(buffer, 0, sizeof(buffer));
 			if (callback != NULL){
 				if (callback((*i)->getConnectionId(), buffer, data)){
+					if (limited){
+						consume(*i, RATE_OUTBOUND_BYTES, RATE_OUTBOUND_MESSAGES, strnlen(buffer, MAX_BUFFER_SIZE), 1, now);
+					}
+					if (m_capture != NULL){
+						capture(*i, CAPTURE_WRITE, 0, buffer, strnlen(buffer, MAX_BUFFER_SIZE));
+					}
 					if (!(*i)->writeToConnection(buffer)){
 						kickConnection(*i);
 						m_connections.erase(i);
@@ -214,7 +1201,105 @@ void server::writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], v
 			}
 			i=j;
 		}
-		free(buffer);
+		if (m_admission != NULL){
+			m_admission->busy(admissionControl::now() - start);
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+}
+
+bool server::writeToStream(int64_t id, uint32_t stream, const char * buffer, size_t size){
+	bool written = false;
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to write to a stream on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		if (size == 0 || size > MUX_MAX_MESSAGE_SIZE){
+			throw serverError("invalid stream message size", ERROR_CLIENT_WRITE);
+		}
+		for (auto i = m_connections.begin(); i != m_connections.end();){
+			auto j = i;
+			j++;
+			if ((*i)->getConnectionId() == id && (*i)->isMultiplexed()){
+				if (!(*i)->writeToStream(stream, buffer, size)){
+					kickConnection(*i);
+					m_connections.erase(i);
+				}
+				else {
+					if (m_capture != NULL){
+						capture(*i, CAPTURE_WRITE, stream, buffer, size);
+					}
+					written = true;
+				}
+			}
+			i=j;
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+	return written;
+}
+
+bool server::sendFileToConnection(int64_t id, int32_t fd, off_t offset, size_t len){
+	bool queued = false;
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to send a file on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		uint64_t size = len;
+		if (m_capture != NULL && len == 0){
+			struct stat status;
+			size = fstat(fd, &status) == 0 && status.st_size > offset ? status.st_size - offset : 0;
+		}
+		for (auto i = m_connections.begin(); i != m_connections.end(); i++){
+			if ((*i)->getConnectionId() == id && (*i)->sendFile(fd, offset, len)){
+				/* the bytes of the file aren't stored, only their number so a replay expects them */
+				for (uint64_t left = size; m_capture != NULL && left > 0;){
+					uint32_t part = left < UINT32_MAX ? left : UINT32_MAX;
+					capture(*i, CAPTURE_WRITE, 0, NULL, part);
+					left -= part;
+				}
+				queued = true;
+			}
+		}
+	}
+	catch (const serverError& error){
+		error.outputMessage();
+	}
+	return queued;
+}
+
+void server::flushConnections(void callback(int64_t, int32_t, void *), void * data){
+	try {
+		if (m_mainSocket == -1){
+			throw serverError("trying to flush connections on an unlaunched server", ERROR_SERVER_NOT_LAUNCHED);
+		}
+		bool limited = m_connectionLimits.enabled() || m_idLimits.enabled();
+		uint64_t now = limited ? admissionControl::now() : 0;
+		uint64_t start = m_admission != NULL ? admissionControl::now() : 0;
+		for (auto i = m_connections.begin(); i != m_connections.end();){
+			auto j = i;
+			j++;
+			if (!(*i)->hasPendingOutput() || (limited && throttled(*i, RATE_OUTBOUND_BYTES, RATE_OUTBOUND_MESSAGES, now))){
+				i=j;
+				continue;
+			}
+			size_t pending = (*i)->pendingOutputBytes();
+			if (!(*i)->flush(callback, data)){
+				kickConnection(*i);
+				m_connections.erase(i);
+			}
+			else if (limited){
+				consume(*i, RATE_OUTBOUND_BYTES, RATE_OUTBOUND_MESSAGES, pending - (*i)->pendingOutputBytes(), 0, now);
+			}
+			i=j;
+		}
+		if (m_admission != NULL){
+			m_admission->busy(admissionControl::now() - start);
+		}
 	}
 	catch (const serverError& error){
 		error.outputMessage();
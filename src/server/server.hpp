@@ -6,24 +6,46 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <poll.h>
 
 #include <openssl/ssl.h>
 
 #include <string>
 #include <cstdint>
 #include <list>
+#include <map>
+#include <vector>
 
 #include "connection.hpp"
+#include "basic_server.hpp"
+#include "admission.hpp"
+#include "ratelimit.hpp"
+#include "trace.hpp"
+#include "balancer.hpp"
+#include "capture.hpp"
 #include "error.hpp"
+
+#define TRANSPORT_TCP4 0
+#define TRANSPORT_TCP6 1
+#define TRANSPORT_UNIX 2
+#define HANDOVER_TIMEOUT 5000
+#define HANDOVER_MAGIC "TLHO"
+#define HANDOVER_ACK_TIMEOUT 1000
+/* ms handover waits for the new server to acknowledge the listening socket
+ */
+
 /* this class is used to setup a server which handles cyphered or uncyphered connections
  */
 class server
 {
 public:
 	server(uint16_t port, uint32_t maxConnections, bool tlsMode, bool blocking, uint32_t maxInactivityCounter = 0, uint32_t maxConnectionCounter = 0, const std::string& pathToKeyFile = "", const std::string& pathToCertFile = "");
-	/* port : the port of the server
+	/* port : the port of the server (ignored for unix domain sockets)
 	 * maxConnections : the maximum number of connections that can be connected simultaneously
 	 * tlsMode : enabled : connection is cyphered with tls, disabled : simple sockets
 	 * blocking : blocking calls
@@ -32,6 +54,19 @@ public:
 	 * pathToCertFile : path to the certificate used (tls mode)
 	 */
 	~server();
+	void useIPv6(bool dualStack = true);
+	/* listen on an IPv6 socket instead of IPv4, if dualStack is true IPv4 clients are accepted too
+	 * must be called before launch
+	 */
+	void useUnixSocket(const std::string& path, bool abstractNamespace = false);
+	/* listen on a unix domain stream socket bound to path instead of a tcp port
+	 * abstractNamespace : the socket is created in the linux abstract namespace (no file is created)
+	 * launch replaces an existing file only if it is the socket of a server which isn't running any more
+	 * must be called before launch
+	 */
+	uint8_t transport() const;
+	/* returns the transport used (TRANSPORT_TCP4, TRANSPORT_TCP6 or TRANSPORT_UNIX)
+	 */
 	bool launch();
 	/* launches the server, must be called before any other call
 	 * returns true on success, false otherwise
@@ -39,15 +74,159 @@ public:
 	void shutdown();
 	/* shutdowns the server and kicks every connection
 	 */
+	bool inheritListener(const std::string& path, int32_t timeout = HANDOVER_TIMEOUT);
+	/* launches the server on the listening socket of a running server instead of creating one (see enableHandover)
+	 * path : control socket of the running server, waits at most timeout ms for it
+	 * the tls context is created before connecting and the socket is acknowledged once received, on failure the running server keeps accepting
+	 * the transport and port are the ones of the inherited socket, connections waiting to be accepted are not lost
+	 * returns true on success, false otherwise (launch can then be used)
+	 */
+	bool enableHandover(const std::string& path);
+	/* creates a unix control socket at path through which a new process can take the listening socket over (see handover)
+	 * only the owner can connect to it (mode 0600) and a file at path is only replaced if it is the socket of a stopped server
+	 * must be called after launch
+	 * returns true on success, false otherwise
+	 */
+	bool handover();
+	/* sends the listening socket to the process waiting on the control socket, if any and if it runs as the same user
+	 * doesn't block when no process is waiting, otherwise waits at most HANDOVER_ACK_TIMEOUT ms for its acknowledgement
+	 * the server then drains : it doesn't accept connections anymore but keeps serving the current ones
+	 * without acknowledgement it keeps accepting and the control socket is created again
+	 * returns true once the listening socket has been handed over
+	 */
+	bool draining() const;
+	/* returns true if the listening socket has been handed over
+	 */
+	uint32_t drainConnections(uint32_t count);
+	/* kicks at most count connections of a draining server, calling it regularly spreads the reconnections over time
+	 * instead of sending every client to the new process at once
+	 * returns the number of connections left
+	 */
+	bool reloadCertificate(const std::string& pathToKeyFile = "", const std::string& pathToCertFile = "");
+	/* loads the key and certificate (the current paths if empty) in a new tls context which replaces the current one
+	 * new connections use it, established connections keep the context they were accepted with
+	 * on failure the current context is kept
+	 * returns true on success, false otherwise
+	 */
+	bool shareListener(const server& listener);
+	/* launches the server on a copy of the listening socket of listener (which must be launched) to run one server per thread
+	 * both servers must use the same blocking mode, the other options must be set before as for launch
+	 * returns true on success, false otherwise
+	 */
+	void setLoadBalancer(loadBalancer * balancer, uint32_t worker);
+	/* makes the server the worker number worker of balancer (NULL stops balancing), each balanced server must be run by its own thread
+	 * acceptConnection then only accepts connections while this server is the least loaded worker
+	 */
+	void balanceConnections();
+	/* safe point of a balanced server, must be called by its loop between the other calls :
+	 * takes the connections moved to this server, measures the load of each connection every LOAD_WINDOW
+	 * and if this server is the most loaded worker, moves one connection to the least loaded one
+	 * connections still in handshake and compressed connections (compression contexts belong to their server) aren't moved
+	 * after a move, the id based calls of this server (writeToStream, sendFileToConnection) don't find the connection anymore :
+	 * they must be made on the server of the new worker, by its thread (see setMigrationCallback)
+	 */
+	void setMigrationCallback(void callback(int64_t, uint32_t, void *), void * data);
+	/* callback is called by balanceConnections with the id of each connection moved away, the worker which gets it and data
+	 * so the application can route the next messages of this id to the server of that worker
+	 */
+	uint64_t load() const;
+	/* returns the work per second of the connections in microseconds (callback time plus LOAD_MESSAGE_COST per message
+	 * and one microsecond per LOAD_BYTE_COST bytes), measured by balanceConnections
+	 */
+	bool enableCompression(const std::string& pathToDictionary = "", int32_t level = 3, uint32_t threshold = 128);
+	/* allows clients to negociate zstd compression of their messages (requires a build with TLS_USE_ZSTD)
+	 * pathToDictionary : shared dictionary, clients must use the same one (empty for no dictionary)
+	 * level : zstd compression level
+	 * threshold : messages smaller than threshold bytes are sent uncompressed
+	 * returns true on success, false otherwise
+	 */
+	void enableMultiplexing();
+	/* allows clients to open several streams on one connection (see client::enableMultiplexing)
+	 * must be called before launch
+	 */
+	void setLowMemoryMode(bool lowMemory);
+	/* reduces the memory held by idle tls connections : OpenSSL releases the read and write buffers
+	 * of a connection when they are empty (SSL_MODE_RELEASE_BUFFERS), about 33KB per idle connection
+	 * must be called before launch
+	 */
+	void setLeanMode(bool lean);
+	/* lean : connections are handled by the basic_server specialized for the tls and blocking modes (see basic_server.hpp)
+	 * they are stored by value, hold no outbound queue and their messages are written in place (a non-blocking connection whose socket is full is kicked)
+	 * compression, multiplexing, admission control, rate limits and load balancing aren't available, launch fails if one of them is enabled
+	 * connections can't be reached by id (writeToStream, sendFileToConnection) and aren't traced nor captured
+	 * must be called before launch
+	 */
+	size_t memoryUsage() const;
+	/* returns the number of bytes used by the server and its connections (tls memory is estimated)
+	 */
+	void memoryUsagePerConnection(void callback(int64_t, size_t, void *), void * data) const;
+	/* calls callback for each connection with :
+	 * the connection id as an int64_t
+	 * the number of bytes used by the connection (see connection::memoryUsage)
+	 * the pointer data passed as a void *
+	 */
+	void enableTracing(uint32_t capacity, uint32_t sampleInterval = 1);
+	/* records the timings of one message out of sampleInterval read by readFromConnections in a ring of capacity records :
+	 * time spent waiting for the loop, reading, in the callback and writing the response (see traceRecord in trace.hpp)
+	 * can be called at any time, the previous records are dropped
+	 */
+	void disableTracing();
+	/* stops recording and frees the ring, tracing then costs nothing
+	 */
+	bool dumpTrace(const std::string& path) const;
+	/* writes the recorded messages in the file path (see traceRing::dump)
+	 * returns true on success, false otherwise
+	 */
+	bool enableCapture(const std::string& path, uint64_t capacity);
+	/* records the traffic of every connection in the file path (see captureLog) for replayDriver :
+	 * accepts, messages given to the callbacks, messages written (only the size of the files sent) and kicks, with their timestamps
+	 * capacity : maximum size of the records in bytes, the following ones are dropped
+	 * can be called at any time, connections already accepted get an accept record on their first event
+	 * a connection moved by balanceConnections gets a kick record here and an accept record in the capture of its new server,
+	 * so a replay opens a new client for the rest of its session
+	 * returns true on success, false otherwise
+	 */
+	void disableCapture();
+	/* stops recording and closes the file
+	 */
+	uint64_t droppedCaptureRecords() const;
+	/* returns the number of records which didn't fit in the capture file
+	 */
 	uint32_t maxConnections() const;
 	/* returns the max number of connections
 	 */
 	uint32_t connectedConnections() const;
 	/* returns the number of currently connected connections
 	 */
+	void setAdmissionControl(uint32_t maxConnectionsPerSource, uint32_t acceptRate = 0, uint32_t acceptBurst = 0, uint32_t maxLoopLag = 0, bool resetOnReject = false);
+	/* limits the connections accepted by acceptConnection (0 disables a limit) :
+	 * maxConnectionsPerSource : maximum number of connections from one source address
+	 * acceptRate : maximum number of connections accepted per second from one source address
+	 * acceptBurst : number of connections from one source address accepted at once before acceptRate applies (acceptRate if 0)
+	 * maxLoopLag : connections are refused while the smoothed work of one event loop iteration is above maxLoopLag microseconds
+	 *   (time spent in the read, write, handshake and flush functions between two calls to acceptConnection, waits in a non-blocking loop aren't counted)
+	 * resetOnReject : refused connections are reset (RST) instead of being closed
+	 * must be called before launch
+	 */
+	uint64_t rejectedConnections() const;
+	/* returns the number of connections refused since launch
+	 */
+	uint32_t loopLag() const;
+	/* returns the smoothed work of one event loop iteration in microseconds (requires admission control)
+	 */
+	void setRateLimit(uint8_t limit, double rate, double burst = 0, bool perConnectionId = false);
+	/* limits the traffic of connections with token buckets :
+	 * limit : RATE_INBOUND_BYTES, RATE_INBOUND_MESSAGES, RATE_OUTBOUND_BYTES or RATE_OUTBOUND_MESSAGES
+	 * rate : bytes or messages allowed per second (0 removes the limit)
+	 * burst : size of the bucket (rate if 0)
+	 * perConnectionId : the bucket is shared by every connection identified with the same id instead of being per connection
+	 * connections over their inbound limit are not read (data stays in the socket) until their buckets are refilled
+	 * connections over their outbound limit are skipped by writeToConnections and flushConnections
+	 */
 	bool acceptConnection();
 	/* accepts one connection waiting of being accepted
-	 * returns true on success, false otherwise
+	 * if the server is full or admission control refuses it, the connection is accepted and closed immediately
+	 * returns true if a connection has been added, false otherwise
 	 */
 	void handshakeConnections();
 	/* try to negociate handshake with connections (tls mode)
@@ -63,6 +242,19 @@ public:
 	 * a pointer to a boolean, if callback returns >= 0 and this boolean is true, content of buffer is immediatly sent to the client
 	 * the callback must return an int64_t which is the new connection id (0 for unchanged, -1 will kick connection, positive will change connection id)
 	 */
+	void readFromStreams(int64_t callback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data);
+	/* same as readFromConnections but the callback is also given the stream of the message (0 for connections which aren't multiplexed)
+	 * and a pointer to the size of the message, so binary messages can be handled
+	 * if the boolean is set to true, the size first bytes of buffer (at most MAX_BUFFER_SIZE) are sent back on the same stream
+	 * readFromConnections can be used with multiplexed connections too, it then ignores the stream number
+	 * for requests sent by rpcClient the stream is the correlation id of the request : the response must be sent on it,
+	 * either right away with the boolean or later with writeToStream
+	 */
+	bool writeToStream(int64_t id, uint32_t stream, const char * buffer, size_t size);
+	/* queues a message on stream of every multiplexed connection identified by id (frames beyond the stream credit are sent by the next read)
+	 * connections on which the write fails are kicked
+	 * returns true if at least one connection has queued the message, false otherwise
+	 */
 	void writeToConnections(bool callback(int64_t, char [MAX_BUFFER_SIZE], void *), void * data	);
 	/* calls a callback for each connection with :
 	 * the connection id as an int64_t (-1 default after connection)
@@ -70,20 +262,84 @@ public:
 	 * the pointer data is passed to callback as a void *
 	 * if the callback returns true buffer is sent to connection, otherwise nothing is done
 	 */
+	bool sendFileToConnection(int64_t id, int32_t fd, off_t offset = 0, size_t len = 0);
+	/* queues a file transfer (see connection::sendFile) on every connection identified by id, except compressed and multiplexed ones
+	 * returns true if at least one connection has queued the transfer, false otherwise
+	 */
+	void flushConnections(void callback(int64_t, int32_t, void *), void * data);
+	/* sends the queued data of each connection, callback is called with :
+	 * the connection id as an int64_t
+	 * the file descriptor of the transfer which has been completed
+	 * the pointer data passed as a void *
+	 * connections on which an error occurs are kicked
+	 */
 private:
 	void kickConnection(connection * c);
+	void readConnections(int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), int64_t streamCallback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data);
+	bool handleMessage(connection * c, uint32_t stream, char * buffer, size_t size, int64_t callback(int64_t, char [MAX_BUFFER_SIZE], void *, bool *), int64_t streamCallback(int64_t, uint32_t, char [MAX_BUFFER_SIZE], size_t *, void *, bool *), void * data, uint64_t now, traceRecord * record);
+	/* calls the callback for one message and sends the response, returns false if the connection must be kicked
+	 */
+	void rejectConnection();
+	SSL_CTX * createContext(const std::string& pathToKeyFile, const std::string& pathToCertFile);
+	void closeHandover();
+	static bool removeStaleSocket(const std::string& path);
+	/* removes the unix socket file path if no server listens on it any more
+	 * returns true if path doesn't exist (any more), false if it isn't a socket or if it is in use
+	 */
+	void capture(connection * c, uint16_t type, uint32_t stream, const char * message, size_t size);
+	bool movable(connection * c) const;
+	bool leanCompatible() const;
+	/* returns false if a feature the basic_server doesn't handle is enabled
+	 */
+	bool throttled(connection * c, uint8_t bytesLimit, uint8_t messagesLimit, uint64_t now);
+	void consume(connection * c, uint8_t bytesLimit, uint8_t messagesLimit, size_t bytes, size_t messages, uint64_t now);
 	bool m_tlsMode;
 	bool m_blocking;
+	bool m_lowMemory;
+	bool m_multiplexing;
 	uint16_t m_port;
-	struct sockaddr_in m_serverAddress;
+	uint8_t m_transport;
+	bool m_dualStack;
+	bool m_abstractNamespace;
+	std::string m_unixPath;
+	struct sockaddr_storage m_serverAddress;
+	socklen_t m_serverAddressLength;
 	int32_t m_mainSocket;
 	SSL_CTX * m_sslContext;
+	int32_t m_handoverSocket;
+	std::string m_handoverPath;
+	bool m_draining;
+	bool m_sharedListener;
+	/* the listening socket is a copy (see shareListener), the unix socket file belongs to the server which created it
+	 */
+	loadBalancer * m_balancer;
+	uint32_t m_worker;
+	uint64_t m_load;
+	uint64_t m_lastBalance;
+	void (*m_migrationCallback)(int64_t, uint32_t, void *);
+	void * m_migrationData;
 	std::string m_pathToKeyFile;
 	std::string m_pathToCertFile;
 	uint32_t m_maxConnections;
 	std::list<connection*> m_connections;
 	uint32_t m_maxInactivityCounter;
 	uint32_t m_maxConnectionCounter;
+	compressionPool * m_compressionPool;
+	admissionControl * m_admission;
+	uint64_t m_rejectedConnections;
+	rateLimiter m_connectionLimits;
+	rateLimiter m_idLimits;
+	std::map<int64_t, rateState> m_idRates;
+	traceRing * m_trace;
+	captureLog * m_capture;
+	std::map<connection *, uint64_t> m_captured;
+	/* number in the capture of the connections recorded
+	 */
+	uint64_t m_capturedConnections;
+	uint64_t m_lastReadPass;
+	specializedServer * m_lean;
+	/* allocated by setLeanMode, NULL otherwise
+	 */
 };
 
 #endif /* SERVER_HPP */
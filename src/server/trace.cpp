@@ -0,0 +1,64 @@
+#include "trace.hpp"
+
+using namespace std;
+
+traceRing::traceRing(uint32_t capacity, uint32_t sampleInterval) : m_records(NULL), m_capacity(capacity), m_sampleInterval(sampleInterval), m_sampleCounter(0), m_recorded(0){
+	if (m_capacity == 0){
+		m_capacity = 1;
+	}
+	if (m_sampleInterval == 0){
+		m_sampleInterval = 1;
+	}
+	m_records = new traceRecord[m_capacity];
+}
+
+traceRing::~traceRing(){
+	delete[] m_records;
+}
+
+bool traceRing::sample(){
+	if (++m_sampleCounter < m_sampleInterval){
+		return false;
+	}
+	m_sampleCounter = 0;
+	return true;
+}
+
+void traceRing::push(const traceRecord& record){
+	m_records[m_recorded % m_capacity] = record;
+	m_recorded++;
+}
+
+uint32_t traceRing::size() const{
+	return m_recorded < m_capacity ? m_recorded : m_capacity;
+}
+
+uint64_t traceRing::recorded() const{
+	return m_recorded;
+}
+
+bool traceRing::dump(const string& path) const{
+	int32_t fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1){
+		return false;
+	}
+	traceHeader header;
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(traceRecord);
+	header.count = size();
+	header.recorded = m_recorded;
+	bool success = write(fd, &header, sizeof(header)) == sizeof(header);
+	/* the oldest record is at the write position once the ring has wrapped */
+	uint32_t first = m_recorded < m_capacity ? 0 : m_recorded % m_capacity;
+	if (success && first != 0){
+		size_t length = (m_capacity - first) * sizeof(traceRecord);
+		success = write(fd, m_records + first, length) == (ssize_t)length;
+	}
+	if (success){
+		size_t length = (first != 0 ? first : header.count) * sizeof(traceRecord);
+		success = write(fd, m_records, length) == (ssize_t)length;
+	}
+	close(fd);
+	return success;
+}
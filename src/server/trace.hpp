@@ -0,0 +1,97 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <string>
+#include <cstdint>
+
+/* static tracepoints (provider libtls) usable with perf or bpftrace, e.g. bpftrace -e 'usdt:./libtls.so:libtls:read { @[arg1] = count(); }'
+ * they are only built if the library is built with TLS_USE_USDT defined (./configure --with-usdt, requires sys/sdt.h from systemtap)
+ * otherwise they expand to nothing
+ */
+#ifdef TLS_USE_USDT
+#include <sys/sdt.h>
+#define TLS_TRACE1(name, a) DTRACE_PROBE1(libtls, name, a)
+#define TLS_TRACE2(name, a, b) DTRACE_PROBE2(libtls, name, a, b)
+#else
+#define TLS_TRACE1(name, a) do {} while (0)
+#define TLS_TRACE2(name, a, b) do {} while (0)
+#endif
+
+#define TRACE_MAGIC "TLTR"
+#define TRACE_VERSION 1
+#define TRACE_RESPONSE 1
+
+/* one sampled message, durations are in microseconds
+ */
+struct traceRecord
+{
+	uint64_t timestamp;
+	/* monotonic time (see admissionControl::now) when the server started to read the message
+	 */
+	int64_t id;
+	uint32_t loopDelay;
+	/* time elapsed since the previous call to readFromConnections, the message may have waited that long in the socket
+	 */
+	uint32_t readTime;
+	uint32_t callbackTime;
+	uint32_t writeTime;
+	/* time spent to write the response (0 without response)
+	 */
+	uint32_t size;
+	uint32_t flags;
+	/* TRACE_RESPONSE if a response has been written
+	 */
+};
+
+/* header of a dump, followed by count records from the oldest to the newest
+ */
+struct traceHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t count;
+	uint64_t recorded;
+	/* number of records pushed since the ring has been created (recorded - count records have been overwritten)
+	 */
+};
+
+/* this class is a fixed size ring of traceRecord filled by the server when tracing is enabled
+ * once full the oldest records are overwritten, nothing is allocated after construction
+ */
+class traceRing
+{
+public:
+	traceRing(uint32_t capacity, uint32_t sampleInterval);
+	/* capacity : number of records kept
+	 * sampleInterval : one message out of sampleInterval is recorded (every message if 0 or 1)
+	 */
+	~traceRing();
+	bool sample();
+	/* called for each message, returns true if this one must be recorded
+	 */
+	void push(const traceRecord& record);
+	uint32_t size() const;
+	/* returns the number of records currently in the ring
+	 */
+	uint64_t recorded() const;
+	/* returns the number of records pushed since construction
+	 */
+	bool dump(const std::string& path) const;
+	/* writes a traceHeader followed by the records (oldest first) in the file path
+	 * returns true on success, false otherwise
+	 */
+private:
+	traceRecord * m_records;
+	uint32_t m_capacity;
+	uint32_t m_sampleInterval;
+	uint32_t m_sampleCounter;
+	uint64_t m_recorded;
+};
+
+#endif /* TRACE_HPP */
@@ -0,0 +1,165 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+
+#define TRANSPORT_WANT_READ -1
+#define TRANSPORT_WANT_WRITE -2
+#define TRANSPORT_CLOSED -3
+#define TRANSPORT_ERROR -4
+
+/* policies used by basic_server, basic_connection and basic_client to choose at compile time
+ * between plain and tls sockets (transport) and between blocking and non-blocking sockets (io mode)
+ * read and write return the number of bytes read or written, or one of the TRANSPORT_ codes :
+ * TRANSPORT_WANT_READ and TRANSPORT_WANT_WRITE when the call must be retried once the socket is readable or writable
+ */
+
+class blockingIo
+{
+public:
+	static const bool blocking = true;
+	static bool setup(int32_t){
+		return true;
+	}
+};
+
+class nonBlockingIo
+{
+public:
+	static const bool blocking = false;
+	static bool setup(int32_t socket){
+		int options;
+		if ((options = fcntl(socket, F_GETFL)) == -1){
+			return false;
+		}
+		return fcntl(socket, F_SETFL, options | O_NONBLOCK) != -1;
+	}
+};
+
+/* waits until the socket is ready for the call which returned result (TRANSPORT_WANT_READ or TRANSPORT_WANT_WRITE)
+ * returns false on error
+ */
+inline bool transportWait(int32_t socket, ssize_t result){
+	struct pollfd pfd;
+	pfd.fd = socket;
+	pfd.events = result == TRANSPORT_WANT_READ ? POLLIN : POLLOUT;
+	pfd.revents = 0;
+	return poll(&pfd, 1, -1) >= 0 || errno == EINTR;
+}
+
+/* uncyphered transport, holds no state
+ */
+class plainTransport
+{
+public:
+	static const bool tls = false;
+	bool attach(int32_t, SSL_CTX *, bool){
+		return true;
+	}
+	bool handshakeMade() const{
+		return true;
+	}
+	ssize_t handshake(){
+		return 1;
+	}
+	ssize_t read(int32_t socket, char * buffer, size_t size){
+		ssize_t ret = recv(socket, buffer, size, 0);
+		if (ret > 0){
+			return ret;
+		}
+		if (ret == 0){
+			return TRANSPORT_CLOSED;
+		}
+		return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) ? TRANSPORT_WANT_READ : TRANSPORT_ERROR;
+	}
+	ssize_t write(int32_t socket, const char * buffer, size_t size){
+		ssize_t ret = send(socket, buffer, size, 0);
+		if (ret >= 0){
+			return ret;
+		}
+		return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) ? TRANSPORT_WANT_WRITE : TRANSPORT_ERROR;
+	}
+	void release(){
+
+	}
+};
+
+/* tls 1.3 transport, holds the SSL object of the connection
+ * a write which has to be retried must be retried with the same arguments
+ */
+class tlsTransport
+{
+public:
+	static const bool tls = true;
+	tlsTransport() : m_ssl(NULL), m_handshakeMade(false){
+
+	}
+	bool attach(int32_t socket, SSL_CTX * context, bool serverSide){
+		m_ssl = SSL_new(context);
+		if (m_ssl == NULL || SSL_set_fd(m_ssl, socket) == 0){
+			return false;
+		}
+		if (serverSide){
+			SSL_set_accept_state(m_ssl);
+		}
+		else {
+			SSL_set_connect_state(m_ssl);
+		}
+		return true;
+	}
+	bool handshakeMade() const{
+		return m_handshakeMade;
+	}
+	ssize_t handshake(){
+		/* returns 1 once the handshake is made, TRANSPORT_WANT_READ or TRANSPORT_WANT_WRITE while it is in progress and TRANSPORT_ERROR on error */
+		if (m_handshakeMade){
+			return 1;
+		}
+		int ret = SSL_do_handshake(m_ssl);
+		if (ret == 1){
+			m_handshakeMade = true;
+			return 1;
+		}
+		return status(ret);
+	}
+	ssize_t read(int32_t, char * buffer, size_t size){
+		int ret = SSL_read(m_ssl, buffer, size);
+		return ret > 0 ? ret : status(ret);
+	}
+	ssize_t write(int32_t, const char * buffer, size_t size){
+		int ret = SSL_write(m_ssl, buffer, size);
+		return ret > 0 ? ret : status(ret);
+	}
+	void release(){
+		if (m_ssl != NULL){
+			SSL_shutdown(m_ssl);
+			SSL_free(m_ssl);
+			m_ssl = NULL;
+		}
+		m_handshakeMade = false;
+	}
+private:
+	ssize_t status(int ret) const{
+		int tmp = SSL_get_error(m_ssl, ret);
+		if (tmp == SSL_ERROR_WANT_READ){
+			return TRANSPORT_WANT_READ;
+		}
+		if (tmp == SSL_ERROR_WANT_WRITE){
+			return TRANSPORT_WANT_WRITE;
+		}
+		return tmp == SSL_ERROR_ZERO_RETURN ? TRANSPORT_CLOSED : TRANSPORT_ERROR;
+	}
+	SSL * m_ssl;
+	bool m_handshakeMade;
+};
+
+#endif /* TRANSPORT_HPP */
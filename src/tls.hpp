@@ -3,6 +3,12 @@
 
 #include "server/server.hpp"
 #include "server/connection.hpp"
+#include "server/basic_server.hpp"
+#include "server/datagram_server.hpp"
 #include "client/client.hpp"
+#include "client/basic_client.hpp"
+#include "client/datagram_client.hpp"
+#include "client/rpc_client.hpp"
+#include "client/replay.hpp"
 
 #endif /* TLS_HPP */
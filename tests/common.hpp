@@ -0,0 +1,35 @@
+#ifndef TESTS_COMMON_HPP
+#define TESTS_COMMON_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#define TEST_SKIPPED 77
+/* exit status telling automake the test couldn't run
+ */
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)){ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			exit(1); \
+		} \
+	} while (0)
+
+/* creates a temporary file holding content, its path is stored in path
+ * returns the file descriptor of the file, opened for reading and writing
+ */
+inline int temporaryFile(const std::string& content, std::string& path){
+	char name[] = "/tmp/tls_testXXXXXX";
+	int fd = mkstemp(name);
+	CHECK(fd != -1);
+	CHECK(write(fd, content.data(), content.size()) == (ssize_t)content.size());
+	path = name;
+	return fd;
+}
+
+#endif /* TESTS_COMMON_HPP */
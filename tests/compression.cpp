@@ -0,0 +1,163 @@
+#include <atomic>
+#include <thread>
+
+#include "tls.hpp"
+#include "common.hpp"
+
+using namespace std;
+
+/* frames are found in any split of the bytes received
+ */
+static void checkFrames(){
+	compressionPool pool(3, UINT32_MAX);
+	char frames[2 * (MAX_BUFFER_SIZE + COMPRESSION_HEADER_SIZE)];
+	ssize_t first = pool.encode("hello", 5, frames, sizeof(frames));
+	CHECK(first == 5 + COMPRESSION_HEADER_SIZE);
+	ssize_t second = pool.encode("world!", 6, frames + first, sizeof(frames) - first);
+	CHECK(second == 6 + COMPRESSION_HEADER_SIZE);
+	for (ssize_t i = 0; i < first; i++){
+		CHECK(compressionPool::frameSize(frames, i) == 0);
+	}
+	CHECK(compressionPool::frameSize(frames, first + second) == first);
+	CHECK(compressionPool::frameSize(frames + first, second) == second);
+	char message[MAX_BUFFER_SIZE];
+	CHECK(pool.decode(frames, first, message, sizeof(message)) == 5);
+	CHECK(memcmp(message, "hello", 5) == 0);
+	CHECK(pool.decode(frames + first, second, message, sizeof(message)) == 6);
+	CHECK(memcmp(message, "world!", 6) == 0);
+	/* a frame cut or followed by another one isn't decoded */
+	CHECK(pool.decode(frames, first - 1, message, sizeof(message)) == -1);
+	CHECK(pool.decode(frames, first + second, message, sizeof(message)) == -1);
+	frames[0] = 42;
+	CHECK(compressionPool::frameSize(frames, first) == -1);
+}
+
+static int64_t echo(int64_t id, char buffer[MAX_BUFFER_SIZE], void * data, bool * response){
+	if (buffer[0] != '\0'){
+		(*(int *)data)++;
+		*response = true;
+	}
+	return 0;
+}
+
+/* messages written back to back reach the other side in one read, each one must still be returned alone
+ */
+static void checkMergedMessages(){
+	server s(0, 4, false, false);
+	s.useUnixSocket("tls_test_compression", true);
+	CHECK(s.enableCompression());
+	CHECK(s.launch());
+	string large;
+	while (large.size() < 4000){
+		large += "{\"key\":\"value\",\"n\":12345},";
+	}
+	string messages[3] = {large, "short", large.substr(0, 200)};
+	/* 0 : negotiation, 1 : client connected, 2 : server paused, 3 : messages written, 4 : responses written */
+	atomic<int> step(0);
+	bool ok = true;
+	thread peer([&]{
+		client c(false, true, "unix:@tls_test_compression", "");
+		ok = c.enableCompression() && c.connect() && c.isCompressed();
+		step = 1;
+		while (step < 2){
+			usleep(1000);
+		}
+		for (int i = 0; i < 3; i++){
+			ok = ok && c.write(messages[i].data(), messages[i].size());
+		}
+		step = 3;
+		while (step < 4){
+			usleep(1000);
+		}
+		for (int i = 0; i < 3 && ok; i++){
+			char buffer[MAX_BUFFER_SIZE];
+			size_t size = 0;
+			ok = c.read(buffer, &size) && string(buffer, size) == messages[i];
+		}
+	});
+	int handled = 0;
+	for (int i = 0; i < 20000 && step != 4; i++){
+		s.acceptConnection();
+		if (step == 1){
+			step = 2;
+		}
+		/* once connected, the messages are only read after they have all been written */
+		if (step == 0 || step == 3){
+			s.readFromConnections(echo, &handled);
+		}
+		if (handled == 3){
+			step = 4;
+		}
+		usleep(100);
+	}
+	step = 4;
+	peer.join();
+	CHECK(handled == 3);
+	CHECK(ok);
+	s.shutdown();
+}
+
+static int64_t identify(int64_t id, char buffer[MAX_BUFFER_SIZE], void * data, bool * response){
+	if (buffer[0] != '\0'){
+		(*(int *)data)++;
+		*response = true;
+		return 7;
+	}
+	return 0;
+}
+
+/* the bytes of a file would be decoded as compressed frames, both sides refuse to send one and the connection keeps working
+ */
+static void checkFileRefused(){
+	server s(0, 4, false, false);
+	s.useUnixSocket("tls_test_compression_file", true);
+	CHECK(s.enableCompression());
+	CHECK(s.launch());
+	string path;
+	int fd = temporaryFile("raw bytes of a file", path);
+	/* 0 : negotiation, 1 : first message echoed, 2 : file refused by the server, 3 : done */
+	atomic<int> step(0);
+	bool ok = true;
+	thread peer([&]{
+		client c(false, true, "unix:@tls_test_compression_file", "");
+		char buffer[MAX_BUFFER_SIZE];
+		size_t size = 0;
+		ok = c.enableCompression() && c.connect() && c.isCompressed();
+		ok = ok && c.write("first") && c.read(buffer, &size) && string(buffer, size) == "first";
+		ok = ok && !c.sendFile(fd);
+		step = 1;
+		while (step < 2){
+			usleep(1000);
+		}
+		ok = ok && c.write("second") && c.read(buffer, &size) && string(buffer, size) == "second";
+		step = 3;
+	});
+	int handled = 0;
+	for (int i = 0; i < 20000 && step != 3; i++){
+		s.acceptConnection();
+		s.readFromConnections(identify, &handled);
+		if (step == 1){
+			CHECK(!s.sendFileToConnection(7, fd));
+			s.flushConnections(NULL, NULL);
+			step = 2;
+		}
+		usleep(100);
+	}
+	step = 3;
+	peer.join();
+	CHECK(handled == 2);
+	CHECK(ok);
+	s.shutdown();
+	close(fd);
+	unlink(path.c_str());
+}
+
+int main(){
+	checkFrames();
+	if (!compressionPool::available()){
+		return TEST_SKIPPED;
+	}
+	checkMergedMessages();
+	checkFileRefused();
+	return 0;
+}
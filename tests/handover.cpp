@@ -0,0 +1,95 @@
+#include <atomic>
+#include <thread>
+
+#include "tls.hpp"
+#include "common.hpp"
+
+using namespace std;
+
+static int64_t echo(int64_t id, char buffer[MAX_BUFFER_SIZE], void * data, bool * response){
+	if (buffer[0] != '\0'){
+		*response = true;
+	}
+	return 0;
+}
+
+/* returns true if a client gets its message echoed by s, the server loop runs meanwhile
+ */
+static bool served(server& s, const string& path){
+	atomic<bool> done(false);
+	bool ok = false;
+	thread peer([&]{
+		client c(false, true, "unix:" + path, "");
+		char buffer[MAX_BUFFER_SIZE];
+		size_t size = 0;
+		ok = c.connect() && c.write("ping") && c.read(buffer, &size) && string(buffer, size) == "ping";
+		done = true;
+	});
+	for (int i = 0; i < 20000 && !done; i++){
+		s.acceptConnection();
+		s.readFromConnections(echo, NULL);
+		usleep(100);
+	}
+	peer.join();
+	return ok;
+}
+
+/* a new server which can't start (certificate missing) leaves the listening socket to the running one
+ */
+static void checkFailedHandover(const string& path, const string& control){
+	server running(0, 4, false, false);
+	running.useUnixSocket(path);
+	CHECK(running.launch());
+	CHECK(running.enableHandover(control));
+	atomic<bool> done(false);
+	bool inherited = true;
+	thread next([&]{
+		server s(0, 4, true, false, 0, 0, "/nonexistent/key.pem", "/nonexistent/cert.pem");
+		inherited = s.inheritListener(control, 500);
+		done = true;
+	});
+	while (!done){
+		running.handover();
+		usleep(1000);
+	}
+	next.join();
+	CHECK(!inherited);
+	CHECK(!running.draining());
+	CHECK(access(path.c_str(), F_OK) == 0);
+	CHECK(served(running, path));
+	running.shutdown();
+	CHECK(access(path.c_str(), F_OK) != 0);
+}
+
+/* the new server serves the socket once it has acknowledged it, the previous one drains without removing the socket file
+ */
+static void checkHandover(const string& path, const string& control){
+	server running(0, 4, false, false);
+	running.useUnixSocket(path);
+	CHECK(running.launch());
+	CHECK(running.enableHandover(control));
+	server next(0, 4, false, false);
+	bool inherited = false;
+	thread t([&]{
+		inherited = next.inheritListener(control, 2000);
+	});
+	for (int i = 0; i < 2000 && !running.draining(); i++){
+		running.handover();
+		usleep(1000);
+	}
+	t.join();
+	CHECK(inherited);
+	CHECK(running.draining());
+	running.shutdown();
+	CHECK(access(path.c_str(), F_OK) == 0);
+	CHECK(served(next, path));
+	next.shutdown();
+}
+
+int main(){
+	string path = "/tmp/tls_test_handover" + to_string(getpid());
+	string control = path + ".control";
+	checkFailedHandover(path, control);
+	checkHandover(path, control);
+	return 0;
+}
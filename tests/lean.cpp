@@ -0,0 +1,140 @@
+#include <atomic>
+#include <thread>
+
+#include "tls.hpp"
+#include "common.hpp"
+
+using namespace std;
+
+#define BINARY_SIZE 1000
+
+static int64_t echoText(int64_t id, char buffer[MAX_BUFFER_SIZE], void * data, bool * response){
+	if (buffer[0] != '\0'){
+		(*(int *)data)++;
+		*response = true;
+	}
+	return 0;
+}
+
+static int64_t echoBinary(int64_t id, uint32_t stream, char buffer[MAX_BUFFER_SIZE], size_t * size, void * data, bool * response){
+	if (*size > 0){
+		(*(int *)data)++;
+		*response = stream == 0;
+	}
+	return 0;
+}
+
+static string binary(){
+	string m(BINARY_SIZE, '\0');
+	for (size_t i = 0; i < m.size(); i++){
+		m[i] = (i * 7) % 251;
+	}
+	return m;
+}
+
+/* a lean plain blocking server and a lean blocking client : every call waits for the peer
+ */
+static void checkBlocking(){
+	server s(0, 4, false, true);
+	s.useUnixSocket("tls_test_lean", true);
+	s.setLeanMode(true);
+	CHECK(s.launch());
+	atomic<bool> ok(false);
+	thread peer([&]{
+		client c(false, true, "unix:@tls_test_lean", "");
+		c.setLeanMode(true);
+		bool tmp = c.connect() && c.write("hello");
+		char buffer[MAX_BUFFER_SIZE];
+		size_t size = 0;
+		tmp = tmp && c.read(buffer, &size) && size == 5 && string(buffer, size) == "hello";
+		/* null bytes go through readFromStreams untouched */
+		string message = binary();
+		tmp = tmp && c.write(message.data(), message.size());
+		size_t received = 0;
+		while (tmp && received < message.size()){
+			tmp = c.read(buffer, &size) && size > 0 && memcmp(buffer, message.data() + received, size) == 0;
+			received += size;
+		}
+		ok = tmp;
+		c.disconnect();
+	});
+	CHECK(s.acceptConnection());
+	CHECK(s.connectedConnections() == 1);
+	int count = 0;
+	s.readFromConnections(echoText, &count);
+	CHECK(count == 1);
+	/* the binary message is echoed, then the last read sees the client disconnect */
+	while (s.connectedConnections() == 1){
+		s.readFromStreams(echoBinary, &count);
+		s.cleanupConnections();
+	}
+	peer.join();
+	CHECK(count >= 2);
+	CHECK(ok);
+	s.shutdown();
+}
+
+static void countConnection(int64_t id, size_t size, void * data){
+	CHECK(size > 0);
+	(*(int *)data)++;
+}
+
+/* non-blocking server and client in one thread, lean mode refuses what it doesn't handle
+ */
+static void checkNonBlocking(){
+	server s(0, 4, false, false);
+	s.useUnixSocket("tls_test_lean_nb", true);
+	s.setLeanMode(true);
+	CHECK(s.launch());
+	client c(false, false, "unix:@tls_test_lean_nb", "");
+	c.setLeanMode(true);
+	CHECK(c.connect());
+	for (int i = 0; i < 1000 && s.connectedConnections() == 0; i++){
+		s.acceptConnection();
+		usleep(100);
+	}
+	CHECK(s.connectedConnections() == 1);
+	int connections = 0;
+	s.memoryUsagePerConnection(countConnection, &connections);
+	CHECK(connections == 1);
+	CHECK(c.write("ping"));
+	int count = 0;
+	for (int i = 0; i < 1000 && count == 0; i++){
+		s.readFromConnections(echoText, &count);
+		usleep(100);
+	}
+	CHECK(count == 1);
+	char buffer[MAX_BUFFER_SIZE];
+	size_t size = 0;
+	for (int i = 0; i < 1000 && size == 0; i++){
+		CHECK(c.read(buffer, &size));
+		usleep(100);
+	}
+	CHECK(string(buffer, size) == "ping");
+	string path;
+	int fd = temporaryFile("file", path);
+	CHECK(!c.sendFile(fd));
+	close(fd);
+	unlink(path.c_str());
+	c.disconnect();
+	s.shutdown();
+	CHECK(s.connectedConnections() == 0);
+
+	server m(0, 4, false, false);
+	m.useUnixSocket("tls_test_lean_mux", true);
+	m.setLeanMode(true);
+	m.enableMultiplexing();
+	CHECK(!m.launch());
+	client mc(false, false, "unix:@tls_test_lean_mux", "");
+	mc.setLeanMode(true);
+	mc.enableMultiplexing();
+	CHECK(!mc.connect());
+}
+
+int main(){
+	/* a lost message would leave the blocking calls waiting forever */
+	alarm(60);
+	checkBlocking();
+	checkNonBlocking();
+	return 0;
+}
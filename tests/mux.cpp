@@ -0,0 +1,185 @@
+#include <atomic>
+#include <thread>
+#include <map>
+
+#include "tls.hpp"
+#include "common.hpp"
+
+using namespace std;
+
+#define STREAMS 96
+#define MESSAGE_SIZE 8000
+
+/* credit which would overflow the send window is a protocol error
+ */
+static void checkWindowOverflow(){
+	muxSession session(true);
+	uint32_t stream = session.openStream();
+	char frame[MUX_HEADER_SIZE + sizeof(uint32_t)];
+	uint32_t id = htonl(stream);
+	uint16_t length = htons(sizeof(uint32_t));
+	memcpy(frame, &id, sizeof(id));
+	frame[4] = MUX_FRAME_WINDOW;
+	frame[5] = 0;
+	memcpy(frame + 6, &length, sizeof(length));
+	uint32_t increment = htonl(UINT32_MAX - MUX_INITIAL_WINDOW);
+	memcpy(frame + MUX_HEADER_SIZE, &increment, sizeof(increment));
+	CHECK(session.consume(frame, sizeof(frame)));
+	increment = htonl(1);
+	memcpy(frame + MUX_HEADER_SIZE, &increment, sizeof(increment));
+	CHECK(!session.consume(frame, sizeof(frame)));
+}
+
+/* messages with null bytes, so a response cut at its first null byte is seen
+ */
+static string message(uint32_t stream){
+	string m(MESSAGE_SIZE, '\0');
+	for (size_t i = 0; i < m.size(); i++){
+		m[i] = (i * 7 + stream) % 251;
+	}
+	return m;
+}
+
+static int64_t echo(int64_t id, uint32_t stream, char buffer[MAX_BUFFER_SIZE], size_t * size, void * data, bool * response){
+	if (*size > 0){
+		(*(int *)data)++;
+		*response = true;
+	}
+	return 0;
+}
+
+/* bursts larger than the socket buffers leave partial writes on both sides, every message must still arrive whole
+ * blocking : the client writes while the server reads, then reads once every response is queued by the server,
+ * otherwise the client writes everything before the server reads
+ */
+static void checkBursts(bool blocking){
+	server s(0, 4, false, false);
+	s.useUnixSocket("tls_test_mux", true);
+	s.enableMultiplexing();
+	CHECK(s.launch());
+	/* 0 : negotiation, 1 : client connected, 2 : requests written, 3 : requests handled, 4 : responses read */
+	atomic<int> step(0);
+	bool ok = true;
+	thread peer([&]{
+		client c(false, blocking, "unix:@tls_test_mux", "");
+		c.enableMultiplexing();
+		ok = c.connect() && c.isMultiplexed();
+		step = 1;
+		map<uint32_t, string> expected;
+		for (int i = 0; i < STREAMS && ok; i++){
+			uint32_t stream = c.openStream();
+			expected[stream] = message(stream);
+			ok = c.writeToStream(stream, expected[stream].data(), expected[stream].size());
+		}
+		step = 2;
+		while (blocking && ok && step < 3){
+			usleep(1000);
+		}
+		for (int i = 0; i < 20000 && ok && !expected.empty(); i++){
+			char buffer[MAX_BUFFER_SIZE];
+			size_t size = 0;
+			uint32_t stream;
+			ok = c.readFromStreams(&stream, buffer, &size);
+			if (ok && size > 0){
+				auto e = expected.find(stream);
+				ok = e != expected.end() && string(buffer, size) == e->second;
+				expected.erase(stream);
+			}
+			else if (size == 0){
+				usleep(100);
+			}
+		}
+		ok = ok && expected.empty();
+		step = 4;
+	});
+	int count = 0;
+	for (int i = 0; i < 50000 && step != 4; i++){
+		s.acceptConnection();
+		if (step == 0 || step >= 2 || blocking){
+			s.readFromStreams(echo, &count);
+		}
+		if (count == STREAMS && step == 2){
+			step = 3;
+		}
+		usleep(100);
+	}
+	step = 4;
+	peer.join();
+	CHECK(count == STREAMS);
+	CHECK(ok);
+	s.shutdown();
+}
+
+static int64_t identify(int64_t id, uint32_t stream, char buffer[MAX_BUFFER_SIZE], size_t * size, void * data, bool * response){
+	if (*size > 0){
+		(*(int *)data)++;
+		*response = true;
+	}
+	return 7;
+}
+
+/* raw file bytes would be read as stream frames, both sides refuse to send files once multiplexing is negociated
+ */
+static void checkFileRefused(){
+	server s(0, 4, false, false);
+	s.useUnixSocket("tls_test_mux_file", true);
+	s.enableMultiplexing();
+	CHECK(s.launch());
+	string path;
+	int fd = temporaryFile("raw bytes of a file", path);
+	/* 0 : negotiation, 1 : first message echoed, 2 : file refused by the server, 3 : done */
+	atomic<int> step(0);
+	bool ok = true;
+	thread peer([&]{
+		client c(false, true, "unix:@tls_test_mux_file", "");
+		c.enableMultiplexing();
+		ok = c.connect() && c.isMultiplexed();
+		uint32_t stream = c.openStream();
+		auto echoed = [&](const string& m){
+			char buffer[MAX_BUFFER_SIZE];
+			size_t size = 0;
+			uint32_t from = 0;
+			bool tmp = c.writeToStream(stream, m.data(), m.size());
+			while (tmp && size == 0){
+				tmp = c.readFromStreams(&from, buffer, &size);
+			}
+			return tmp && from == stream && string(buffer, size) == m;
+		};
+		ok = ok && echoed("first");
+		ok = ok && !c.sendFile(fd);
+		step = 1;
+		while (step < 2){
+			usleep(1000);
+		}
+		ok = ok && echoed("second");
+		step = 3;
+	});
+	int handled = 0;
+	for (int i = 0; i < 20000 && step != 3; i++){
+		s.acceptConnection();
+		s.readFromStreams(identify, &handled);
+		if (step == 1){
+			CHECK(!s.sendFileToConnection(7, fd));
+			s.flushConnections(NULL, NULL);
+			step = 2;
+		}
+		usleep(100);
+	}
+	step = 3;
+	peer.join();
+	CHECK(handled == 2);
+	CHECK(ok);
+	s.shutdown();
+	close(fd);
+	unlink(path.c_str());
+}
+
+int main(){
+	/* a lost frame would leave the blocking client waiting forever */
+	alarm(60);
+	checkWindowOverflow();
+	checkBursts(true);
+	checkBursts(false);
+	checkFileRefused();
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include <sys/socket.h>
+
+#include "server/outbound.hpp"
+#include "common.hpp"
+
+using namespace std;
+
+/* reads exactly size bytes from socket
+ */
+static string receive(int socket, size_t size){
+	string data;
+	char buffer[4096];
+	while (data.size() < size){
+		ssize_t ret = recv(socket, buffer, sizeof(buffer) < size - data.size() ? sizeof(buffer) : size - data.size(), 0);
+		CHECK(ret > 0);
+		data.append(buffer, ret);
+	}
+	return data;
+}
+
+/* a range which isn't entirely in the file is refused when it is queued
+ */
+static void checkRanges(int fd){
+	outboundQueue queue;
+	CHECK(!queue.pushFile(fd, 50, 60));
+	CHECK(!queue.pushFile(fd, 100, 0));
+	CHECK(!queue.pushFile(fd, 200, 1));
+	CHECK(!queue.pushFile(-1, 0, 0));
+	CHECK(queue.pushFile(fd, 50, 50));
+	CHECK(queue.pushFile(fd, 0, 0));
+	CHECK(queue.pendingBytes() == 150);
+}
+
+/* a file which shrinks while it is sent fails the transfer instead of waiting forever for the missing bytes
+ */
+static void checkTruncation(const string& content, int fd, int sockets[2]){
+	outboundQueue queue;
+	CHECK(queue.pushFile(fd, 0, 0));
+	CHECK(ftruncate(fd, 10) == 0);
+	int32_t ret = 0;
+	/* the socket is blocking, a transfer which never ends would loop here */
+	for (int i = 0; i < 100 && ret == 0; i++){
+		ret = queue.progress(sockets[0], NULL, NULL);
+	}
+	CHECK(ret == -1);
+	CHECK(errno == ENODATA);
+	CHECK(receive(sockets[1], 10) == content.substr(0, 10));
+	CHECK(pwrite(fd, content.data(), content.size(), 0) == (ssize_t)content.size());
+}
+
+/* messages queued behind a file are sent after it, in order
+ */
+static void checkOrder(const string& content, int fd, int sockets[2]){
+	outboundQueue queue;
+	queue.pushMessage("first", 5);
+	CHECK(queue.frontIsMessage());
+	CHECK(queue.pushFile(fd, 0, 0));
+	queue.pushMessage("second", 6);
+	CHECK(queue.pendingBytes() == 5 + content.size() + 6);
+	int32_t completedFd = 0;
+	int32_t files = 0;
+	int32_t messages = 0;
+	while (!queue.empty()){
+		int32_t ret = queue.progress(sockets[0], NULL, &completedFd);
+		CHECK(ret != -1);
+		if (ret == 1){
+			if (completedFd == fd){
+				files++;
+			}
+			else {
+				CHECK(completedFd == -1);
+				messages++;
+			}
+		}
+	}
+	CHECK(files == 1 && messages == 2);
+	CHECK(receive(sockets[1], 5 + content.size() + 6) == "first" + content + "second");
+}
+
+int main(){
+	string content;
+	for (int i = 0; i < 100; i++){
+		content += (char)('a' + i % 26);
+	}
+	string path;
+	int fd = temporaryFile(content, path);
+	int sockets[2];
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+	checkRanges(fd);
+	checkTruncation(content, fd, sockets);
+	checkOrder(content, fd, sockets);
+	close(sockets[0]);
+	close(sockets[1]);
+	close(fd);
+	unlink(path.c_str());
+	return 0;
+}